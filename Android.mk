@@ -9,6 +9,7 @@ LOCAL_PATH:= $(call my-dir)
 common_SRC_FILES:= \
         base64.c \
         buffer.c  \
+        comp-lz4.c  \
         crypto.c  \
         dhcp.c  \
         error.c  \
@@ -26,6 +27,7 @@ common_SRC_FILES:= \
         lzo.c  \
         manage.c  \
         mbuf.c  \
+        metrics.c  \
         misc.c  \
         mroute.c  \
         mss.c  \
@@ -51,6 +53,7 @@ common_SRC_FILES:= \
         ps.c  \
         push.c  \
         reliable.c  \
+        ring.c  \
         route.c  \
         schedule.c  \
         session_id.c  \
@@ -74,6 +77,7 @@ common_C_INCLUDES += \
 	$(LOCAL_PATH)/../openssl/crypto/evp \
 	$(LOCAL_PATH)/../openssl/ssl \
 	$(LOCAL_PATH)/../liblzo/include \
+	$(LOCAL_PATH)/../lz4/lib \
 
 common_SHARED_LIBRARIES := 
 
@@ -94,12 +98,14 @@ endif
 #LOCAL_SHARED_LIBRARIES += \
 	libcrypto \
 	libssl \
-	liblzo
+	liblzo \
+	liblz4
 
 #LOCAL_STATIC_LIBRARIES := \
 	libcrypto-static \
 	libssl-static \
-	liblzo-static
+	liblzo-static \
+	liblz4-static
 #LOCAL_PRELINK_MODULE:= false
 #LOCAL_LDFLAGS := -static -static-libgcc
 #LOCAL_MODULE:= openvpn-static
@@ -117,7 +123,7 @@ LOCAL_SRC_FILES:= $(common_SRC_FILES)
 LOCAL_CFLAGS:= $(common_CFLAGS)
 LOCAL_C_INCLUDES:= $(common_C_INCLUDES)
 
-LOCAL_SHARED_LIBRARIES:= $(common_SHARED_LIBRARIES) libssl libcrypto liblzo
+LOCAL_SHARED_LIBRARIES:= $(common_SHARED_LIBRARIES) libssl libcrypto liblzo liblz4
 
 #LOCAL_LDLIBS += -ldl
 #LOCAL_PRELINK_MODULE:= false
@@ -283,6 +283,25 @@ buf_write_string_file (const struct buffer *buf, const char *filename, int fd)
  * Garbage collection
  */
 
+/* alignment of memory returned by gc_malloc */
+#define GC_ALIGN (2 * sizeof (void *))
+
+/* header size rounded up so that payloads start aligned */
+#define GC_HEADER_SIZE ((sizeof (struct gc_entry) + GC_ALIGN - 1) & ~(GC_ALIGN - 1))
+
+/*
+ * Payload bytes per arena chunk, sized so that header and
+ * payload together are exactly 1 KB.  Anything bigger than a
+ * quarter chunk gets its own entry.  With DMALLOC every
+ * allocation keeps its own entry, so leaks are still
+ * reported against the allocating file/line.
+ */
+#ifdef DMALLOC
+#define GC_CHUNK_SIZE 0
+#else
+#define GC_CHUNK_SIZE (1024 - GC_HEADER_SIZE)
+#endif
+
 void *
 #ifdef DMALLOC
 gc_malloc_debug (size_t size, bool clear, struct gc_arena *a, const char *file, int line)
@@ -293,16 +312,44 @@ gc_malloc (size_t size, bool clear, struct gc_arena *a)
   void *ret;
   if (a)
     {
-      struct gc_entry *e;
+      const size_t asize = (size + GC_ALIGN - 1) & ~(GC_ALIGN - 1);
+      struct gc_entry *e = a->list;
+
+      if (e && asize <= e->size - e->used)
+	{
+	  /* fast path: bump within the current chunk */
+	  ret = (uint8_t *) e + GC_HEADER_SIZE + e->used;
+	  e->used += asize;
+	}
+      else
+	{
+	  const bool dedicated = (asize > GC_CHUNK_SIZE / 4);
+	  const size_t esize = dedicated ? asize : GC_CHUNK_SIZE;
+
+	  if (asize < size || GC_HEADER_SIZE + esize < esize)
+	    out_of_memory ();
 #ifdef DMALLOC
-      e = (struct gc_entry *) openvpn_dmalloc (file, line, size + sizeof (struct gc_entry));
+	  e = (struct gc_entry *) openvpn_dmalloc (file, line, GC_HEADER_SIZE + esize);
 #else
-      e = (struct gc_entry *) malloc (size + sizeof (struct gc_entry));
+	  e = (struct gc_entry *) malloc (GC_HEADER_SIZE + esize);
 #endif
-      check_malloc_return (e);
-      ret = (char *) e + sizeof (struct gc_entry);
-      e->next = a->list;
-      a->list = e;
+	  check_malloc_return (e);
+	  e->size = esize;
+	  e->used = asize;
+	  ret = (uint8_t *) e + GC_HEADER_SIZE;
+
+	  if (dedicated && a->list)
+	    {
+	      /* keep bumping into the current chunk */
+	      e->next = a->list->next;
+	      a->list->next = e;
+	    }
+	  else
+	    {
+	      e->next = a->list;
+	      a->list = e;
+	    }
+	}
     }
   else
     {
@@ -59,9 +59,18 @@ struct buffer
 
 /* for garbage collection */
 
+/*
+ * Arena memory is carved out of chunks with a bump pointer.
+ * The bump state lives in the chunk header, not in struct
+ * gc_arena, so an arena stays a single pointer that can be
+ * returned and stored by value.  Requests too large to share
+ * a chunk get a dedicated entry with used == size.
+ */
 struct gc_entry
 {
   struct gc_entry *next;
+  size_t used;
+  size_t size;
 };
 
 struct gc_arena
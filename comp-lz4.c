@@ -0,0 +1,76 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#if defined(USE_LZO) && defined(USE_LZ4)
+
+#include <lz4.h>
+
+#include "comp-lz4.h"
+#include "error.h"
+
+#include "memdbg.h"
+
+static int
+lz4_alg_compress (const uint8_t *src, int src_len,
+		  uint8_t *dst, int *dst_len, void *wmem)
+{
+  const int zlen = LZ4_compress_fast_extState (wmem, (const char *)src, (char *)dst,
+					       src_len, *dst_len, 1);
+  if (zlen <= 0)
+    return -1;
+  *dst_len = zlen;
+  return 0;
+}
+
+static int
+lz4_alg_decompress (const uint8_t *src, int src_len,
+		    uint8_t *dst, int *dst_len)
+{
+  const int zlen = LZ4_decompress_safe ((const char *)src, (char *)dst,
+					src_len, *dst_len);
+  if (zlen < 0)
+    return zlen;
+  *dst_len = zlen;
+  return 0;
+}
+
+/*
+ * LZ4_STREAMSIZE is gone since lz4 1.9.4; LZ4_stream_t is the
+ * state LZ4_compress_fast_extState() expects in every version
+ * that has it, and LZ4_sizeofState() is not a constant.
+ */
+const struct compress_alg lz4_alg = {
+  "LZ4",
+  0x69,
+  sizeof (LZ4_stream_t),
+  NULL,
+  lz4_alg_compress,
+  lz4_alg_decompress
+};
+
+#else
+static void dummy(void) {}
+#endif /* USE_LZO && USE_LZ4 */
@@ -76,6 +76,9 @@
 /* Define to 1 if you have the `chsize' function. */
 /* #undef HAVE_CHSIZE */
 
+/* Define to 1 if you have the `clock_gettime' function. */
+#define HAVE_CLOCK_GETTIME 1
+
 /* struct cmsghdr needed for extended socket error support */
 #define HAVE_CMSGHDR 1
 
@@ -529,6 +532,9 @@
 /* Use LoadLibrary to load DLLs on Windows */
 /* #undef USE_LOAD_LIBRARY */
 
+/* Use LZ4 compression library */
+#define USE_LZ4 1
+
 /* Use LZO compression library */
 #define USE_LZO 1
 
@@ -29,6 +29,7 @@
 #include "crypto.h"
 #include "error.h"
 #include "misc.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -68,15 +69,126 @@
  */
 
 #define CRYPT_ERROR(format) \
-  do { msg (D_CRYPT_ERRORS, "%s: " format, error_prefix); goto error_exit; } while (false)
+  do { metric_drop (METRIC_DROP_DECRYPT); msg (D_CRYPT_ERRORS, "%s: " format, error_prefix); goto error_exit; } while (false)
 
-void
-openvpn_encrypt (struct buffer *buf, struct buffer work,
-		 const struct crypto_options *opt,
-		 const struct frame* frame)
+/*
+ * Packet content dumps are formatted out of line, with their
+ * own gc_arena, so that the per-packet path does no arena
+ * bookkeeping or hex formatting unless D_PACKET_CONTENT is on.
+ */
+#ifdef ENABLE_DEBUG
+
+static void
+crypto_dump (const char *prefix, const uint8_t *data, int len, int maxoutput)
+{
+  struct gc_arena gc = gc_new ();
+  dmsg (D_PACKET_CONTENT, "%s: %s", prefix, format_hex (data, len, maxoutput, &gc));
+  gc_free (&gc);
+}
+
+#define CRYPTO_DUMP(prefix, data, len, maxoutput) \
+  do { if (check_debug_level (D_PACKET_CONTENT)) crypto_dump (prefix, data, len, maxoutput); } while (false)
+
+#else
+
+#define CRYPTO_DUMP(prefix, data, len, maxoutput)
+
+#endif
+
+#ifdef HAVE_AEAD_CIPHER_MODES
+
+/*
+ * Build the AEAD nonce from the packet ID at pid (in wire
+ * format) and the implicit IV.
+ */
+static inline void
+aead_nonce (uint8_t *nonce, const uint8_t *pid, const struct key_ctx *ctx)
 {
-  struct gc_arena gc;
-  gc_init (&gc);
+  memcpy (nonce, pid, sizeof (packet_id_type));
+  memcpy (nonce + sizeof (packet_id_type), ctx->implicit_iv, ctx->implicit_iv_len);
+}
+
+/*
+ * Encrypt and authenticate in a single pass.
+ */
+static void
+openvpn_encrypt_aead (struct buffer *buf, struct buffer work,
+		      const struct crypto_options *opt,
+		      const struct frame* frame)
+{
+  struct key_ctx *ctx = &opt->key_ctx_bi->encrypt;
+  uint8_t nonce[EVP_MAX_IV_LENGTH];
+  struct packet_id_net pin;
+  uint8_t ad[sizeof (packet_id_type)];
+  struct buffer adbuf;
+  uint8_t *tag;
+  int outlen;
+
+  /* AEAD mode requires a packet ID, which init_key_type guarantees */
+  ASSERT (opt->packet_id);
+
+  if (work.data == buf->data)
+    {
+      /* in place, ciphertext overwrites the plaintext */
+      work = *buf;
+      work.len = 0;
+    }
+  else
+    ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
+
+  /* packet ID is the additional data and the explicit part of the nonce */
+  buf_set_write (&adbuf, ad, sizeof (ad));
+  packet_id_alloc_outgoing (&opt->packet_id->send, &pin, false);
+  ASSERT (packet_id_write (&pin, &adbuf, false, false));
+  aead_nonce (nonce, ad, ctx);
+
+  if (!buf_safe (&work, buf->len))
+    {
+      msg (D_CRYPT_ERRORS, "ENCRYPT: buffer size error, bl=%d wc=%d wo=%d wl=%d",
+	   buf->len, work.capacity, work.offset, work.len);
+      goto err;
+    }
+
+  ASSERT (EVP_CipherInit_ov (ctx->cipher, NULL, NULL, nonce, DO_ENCRYPT));
+  ASSERT (EVP_CipherUpdate (ctx->cipher, NULL, &outlen, ad, sizeof (packet_id_type)));
+  ASSERT (EVP_CipherUpdate_ov (ctx->cipher, BEND (&work), &outlen, BPTR (buf), BLEN (buf)));
+  work.len += outlen;
+  ASSERT (EVP_CipherFinal (ctx->cipher, BEND (&work), &outlen));
+  work.len += outlen;
+
+  /* wire format is packet ID, tag, ciphertext */
+  tag = buf_prepend (&work, OPENVPN_AEAD_TAG_LENGTH);
+  ASSERT (tag);
+  ASSERT (EVP_CIPHER_CTX_ctrl (ctx->cipher, EVP_CTRL_GCM_GET_TAG, OPENVPN_AEAD_TAG_LENGTH, tag));
+  ASSERT (buf_write_prepend (&work, ad, sizeof (ad)));
+
+  *buf = work;
+  return;
+
+ err:
+  ERR_clear_error ();
+  buf->len = 0;
+}
+
+#endif /* HAVE_AEAD_CIPHER_MODES */
+
+/*
+ * Encrypt and sign one packet.  If iv is not NULL, it holds
+ * the CBC IV to use, otherwise one is generated.
+ */
+static void
+encrypt_packet (struct buffer *buf, struct buffer work,
+		const struct crypto_options *opt,
+		const struct frame* frame,
+		const uint8_t *iv)
+{
+#ifdef HAVE_AEAD_CIPHER_MODES
+  if (buf->len > 0 && opt->key_ctx_bi && opt->key_ctx_bi->encrypt.implicit_iv_len)
+    {
+      openvpn_encrypt_aead (buf, work, opt, frame);
+      return;
+    }
+#endif
 
   if (buf->len > 0 && opt->key_ctx_bi)
     {
@@ -86,8 +198,8 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
       if (ctx->cipher)
 	{
 	  uint8_t iv_buf[EVP_MAX_IV_LENGTH];
-	  const int iv_size = EVP_CIPHER_CTX_iv_length (ctx->cipher);
-	  const unsigned int mode = EVP_CIPHER_CTX_mode (ctx->cipher);  
+	  const int iv_size = ctx->cipher_iv_len;
+	  const unsigned int mode = ctx->cipher_mode;
 	  int outlen;
 
 	  if (mode == EVP_CIPH_CBC_MODE)
@@ -96,7 +208,12 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 
 	      /* generate pseudo-random IV */
 	      if (opt->flags & CO_USE_IV)
-		prng_bytes (iv_buf, iv_size);
+		{
+		  if (iv)
+		    memcpy (iv_buf, iv, iv_size);
+		  else
+		    prng_bytes (iv_buf, iv_size);
+		}
 
 	      /* Put packet ID in plaintext buffer or IV, depending on cipher mode */
 	      if (opt->packet_id)
@@ -124,21 +241,29 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 	      ASSERT (0);
 	    }
 
-	  /* initialize work buffer with FRAME_HEADROOM bytes of prepend capacity */
-	  ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
+	  if (work.data == buf->data)
+	    {
+	      /* in place, ciphertext overwrites the plaintext */
+	      work = *buf;
+	      work.len = 0;
+	    }
+	  else
+	    {
+	      /* initialize work buffer with FRAME_HEADROOM bytes of prepend capacity */
+	      ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
+	    }
 
 	  /* set the IV pseudo-randomly */
 	  if (opt->flags & CO_USE_IV)
-	    dmsg (D_PACKET_CONTENT, "ENCRYPT IV: %s", format_hex (iv_buf, iv_size, 0, &gc));
+	    CRYPTO_DUMP ("ENCRYPT IV", iv_buf, iv_size, 0);
 
-	  dmsg (D_PACKET_CONTENT, "ENCRYPT FROM: %s",
-	       format_hex (BPTR (buf), BLEN (buf), 80, &gc));
+	  CRYPTO_DUMP ("ENCRYPT FROM", BPTR (buf), BLEN (buf), 80);
 
 	  /* cipher_ctx was already initialized with key & keylen */
 	  ASSERT (EVP_CipherInit_ov (ctx->cipher, NULL, NULL, iv_buf, DO_ENCRYPT));
 
 	  /* Buffer overflow check */
-	  if (!buf_safe (&work, buf->len + EVP_CIPHER_CTX_block_size (ctx->cipher)))
+	  if (!buf_safe (&work, buf->len + ctx->cipher_block_size))
 	    {
 	      msg (D_CRYPT_ERRORS, "ENCRYPT: buffer size error, bc=%d bo=%d bl=%d wc=%d wo=%d wl=%d cbs=%d",
 		   buf->capacity,
@@ -147,7 +272,7 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 		   work.capacity,
 		   work.offset,
 		   work.len,
-		   EVP_CIPHER_CTX_block_size (ctx->cipher));
+		   ctx->cipher_block_size);
 	      goto err;
 	    }
 
@@ -168,8 +293,7 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 	      memcpy (output, iv_buf, iv_size);
 	    }
 
-	  dmsg (D_PACKET_CONTENT, "ENCRYPT TO: %s",
-	       format_hex (BPTR (&work), BLEN (&work), 80, &gc));
+	  CRYPTO_DUMP ("ENCRYPT TO", BPTR (&work), BLEN (&work), 80);
 	}
       else				/* No Encryption */
 	{
@@ -190,25 +314,159 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 
 	  HMAC_Init_ex (ctx->hmac, NULL, 0, NULL, NULL);
 	  HMAC_Update (ctx->hmac, BPTR (&work), BLEN (&work));
-	  output = buf_prepend (&work, HMAC_size (ctx->hmac));
+	  output = buf_prepend (&work, ctx->hmac_len);
 	  ASSERT (output);
 	  HMAC_Final (ctx->hmac, output, (unsigned int *)&hmac_len);
-	  ASSERT (hmac_len == HMAC_size (ctx->hmac));
+	  ASSERT (hmac_len == ctx->hmac_len);
 	}
 
       *buf = work;
     }
-
-  gc_free (&gc);
   return;
 
  err:
   ERR_clear_error ();
   buf->len = 0;
-  gc_free (&gc);
   return;
 }
 
+void
+openvpn_encrypt (struct buffer *buf, struct buffer work,
+		 const struct crypto_options *opt,
+		 const struct frame* frame)
+{
+  encrypt_packet (buf, work, opt, frame, NULL);
+}
+
+/*
+ * Encrypt n packets for the same peer back to back, bufs[i]
+ * using work[i] as its workspace.  CBC IVs for the whole batch
+ * are drawn from the PRNG in one call, and the cipher and HMAC
+ * contexts stay hot in cache from one packet to the next.
+ */
+void
+openvpn_encrypt_batch (struct buffer *bufs, struct buffer *work, int n,
+		       const struct crypto_options *opt,
+		       const struct frame* frame)
+{
+  const struct key_ctx *ctx = opt->key_ctx_bi ? &opt->key_ctx_bi->encrypt : NULL;
+  uint8_t ivs[CRYPTO_BATCH_MAX * EVP_MAX_IV_LENGTH];
+  int i, j;
+
+  for (i = 0; i < n; i += CRYPTO_BATCH_MAX)
+    {
+      const int m = min_int (n - i, CRYPTO_BATCH_MAX);
+      const uint8_t *iv = NULL;
+      int iv_size = 0;
+
+      if (ctx && ctx->cipher && ctx->cipher_mode == EVP_CIPH_CBC_MODE
+	  && !ctx->implicit_iv_len && (opt->flags & CO_USE_IV))
+	{
+	  iv_size = ctx->cipher_iv_len;
+	  prng_bytes (ivs, m * iv_size);
+	  iv = ivs;
+	}
+
+      for (j = 0; j < m; ++j)
+	encrypt_packet (&bufs[i + j], work[i + j], opt, frame,
+			iv ? iv + j * iv_size : NULL);
+    }
+}
+
+/*
+ * Check the packet ID of a successfully authenticated
+ * packet against the replay window, and record it.
+ */
+static bool
+crypto_check_replay (const struct crypto_options *opt, const struct packet_id_net *pin,
+		     const char *error_prefix)
+{
+  packet_id_reap_test (&opt->packet_id->rec);
+  if (packet_id_test (&opt->packet_id->rec, pin))
+    {
+      packet_id_add (&opt->packet_id->rec, pin);
+      if (opt->pid_persist && (opt->flags & CO_PACKET_ID_LONG_FORM))
+	packet_id_persist_save_obj (opt->pid_persist, opt->packet_id);
+      return true;
+    }
+  else
+    {
+      metric_drop (METRIC_DROP_REPLAY);
+      if (!(opt->flags & CO_MUTE_REPLAY_WARNINGS))
+	{
+	  struct gc_arena gc = gc_new ();
+	  msg (D_REPLAY_ERRORS, "%s: bad packet ID (may be a replay): %s -- see the man page entry for --no-replay and --replay-window for more info or silence this warning with --mute-replay-warnings",
+	       error_prefix, packet_id_net_print (pin, true, &gc));
+	  gc_free (&gc);
+	}
+      return false;
+    }
+}
+
+#ifdef HAVE_AEAD_CIPHER_MODES
+
+/*
+ * Authenticate and decrypt in a single pass.
+ */
+static bool
+openvpn_decrypt_aead (struct buffer *buf, struct buffer work,
+		      const struct crypto_options *opt,
+		      const struct frame* frame)
+{
+  static const char error_prefix[] = "AEAD Decrypt error";
+  struct key_ctx *ctx = &opt->key_ctx_bi->decrypt;
+  uint8_t nonce[EVP_MAX_IV_LENGTH];
+  struct packet_id_net pin;
+  const uint8_t *ad;
+  uint8_t *tag;
+  int outlen;
+
+  ASSERT (opt->packet_id);
+
+  ASSERT (buf_init (&work, FRAME_HEADROOM_ADJ (frame, FRAME_HEADROOM_MARKER_DECRYPT)));
+
+  ad = BPTR (buf);
+  if (!packet_id_read (&pin, buf, false))
+    CRYPT_ERROR ("error reading packet-id");
+  aead_nonce (nonce, ad, ctx);
+
+  tag = buf_read_alloc (buf, OPENVPN_AEAD_TAG_LENGTH);
+  if (!tag)
+    CRYPT_ERROR ("missing tag");
+
+  if (buf->len < 1)
+    CRYPT_ERROR ("missing payload");
+
+  if (!buf_safe (&work, buf->len))
+    CRYPT_ERROR ("buffer overflow");
+
+  if (!EVP_CipherInit_ov (ctx->cipher, NULL, NULL, nonce, DO_DECRYPT))
+    CRYPT_ERROR ("cipher init failed");
+  if (!EVP_CIPHER_CTX_ctrl (ctx->cipher, EVP_CTRL_GCM_SET_TAG, OPENVPN_AEAD_TAG_LENGTH, tag))
+    CRYPT_ERROR ("setting tag failed");
+  if (!EVP_CipherUpdate (ctx->cipher, NULL, &outlen, ad, sizeof (packet_id_type)))
+    CRYPT_ERROR ("cipher update AD failed");
+  if (!EVP_CipherUpdate_ov (ctx->cipher, BPTR (&work), &outlen, BPTR (buf), BLEN (buf)))
+    CRYPT_ERROR ("cipher update failed");
+  work.len += outlen;
+  if (!EVP_CipherFinal (ctx->cipher, BEND (&work), &outlen))
+    CRYPT_ERROR ("packet tag authentication failed");
+  work.len += outlen;
+
+  if (!crypto_check_replay (opt, &pin, error_prefix))
+    goto error_exit;
+
+  *buf = work;
+  return true;
+
+ error_exit:
+  ERR_clear_error ();
+  buf->len = 0;
+  return false;
+}
+
+#endif /* HAVE_AEAD_CIPHER_MODES */
+
 /*
  * If (opt->flags & CO_USE_IV) is not NULL, we will read an IV from the packet.
  *
@@ -223,8 +481,11 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 		 const struct frame* frame)
 {
   static const char error_prefix[] = "Authenticate/Decrypt packet error";
-  struct gc_arena gc;
-  gc_init (&gc);
+
+#ifdef HAVE_AEAD_CIPHER_MODES
+  if (buf->len > 0 && opt->key_ctx_bi && opt->key_ctx_bi->decrypt.implicit_iv_len)
+    return openvpn_decrypt_aead (buf, work, opt, frame);
+#endif
 
   if (buf->len > 0 && opt->key_ctx_bi)
     {
@@ -242,7 +503,7 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 	  HMAC_Init_ex (ctx->hmac, NULL, 0, NULL, NULL);
 
 	  /* Assume the length of the input HMAC */
-	  hmac_len = HMAC_size (ctx->hmac);
+	  hmac_len = ctx->hmac_len;
 
 	  /* Authentication fails if insufficient data in packet for HMAC */
 	  if (buf->len < hmac_len)
@@ -264,8 +525,8 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 
       if (ctx->cipher)
 	{
-	  const unsigned int mode = EVP_CIPHER_CTX_mode (ctx->cipher);
-	  const int iv_size = EVP_CIPHER_CTX_iv_length (ctx->cipher);
+	  const unsigned int mode = ctx->cipher_mode;
+	  const int iv_size = ctx->cipher_iv_len;
 	  uint8_t iv_buf[EVP_MAX_IV_LENGTH];
 	  int outlen;
 
@@ -284,7 +545,7 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 
 	  /* show the IV's initial state */
 	  if (opt->flags & CO_USE_IV)
-	    dmsg (D_PACKET_CONTENT, "DECRYPT IV: %s", format_hex (iv_buf, iv_size, 0, &gc));
+	    CRYPTO_DUMP ("DECRYPT IV", iv_buf, iv_size, 0);
 
 	  if (buf->len < 1)
 	    CRYPT_ERROR ("missing payload");
@@ -307,8 +568,7 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 	    CRYPT_ERROR ("cipher final failed");
 	  work.len += outlen;
 
-	  dmsg (D_PACKET_CONTENT, "DECRYPT TO: %s",
-	       format_hex (BPTR (&work), BLEN (&work), 80, &gc));
+	  CRYPTO_DUMP ("DECRYPT TO", BPTR (&work), BLEN (&work), 80);
 
 	  /* Get packet ID from plaintext buffer or IV, depending on cipher mode */
 	  {
@@ -350,36 +610,36 @@ openvpn_decrypt (struct buffer *buf, struct buffer work,
 	    }
 	}
       
-      if (have_pin)
-	{
-	  packet_id_reap_test (&opt->packet_id->rec);
-	  if (packet_id_test (&opt->packet_id->rec, &pin))
-	    {
-	      packet_id_add (&opt->packet_id->rec, &pin);
-	      if (opt->pid_persist && (opt->flags & CO_PACKET_ID_LONG_FORM))
-		packet_id_persist_save_obj (opt->pid_persist, opt->packet_id);
-	    }
-	  else
-	    {
-	      if (!(opt->flags & CO_MUTE_REPLAY_WARNINGS))
-	      msg (D_REPLAY_ERRORS, "%s: bad packet ID (may be a replay): %s -- see the man page entry for --no-replay and --replay-window for more info or silence this warning with --mute-replay-warnings",
-		   error_prefix, packet_id_net_print (&pin, true, &gc));
-	      goto error_exit;
-	    }
-	}
+      if (have_pin && !crypto_check_replay (opt, &pin, error_prefix))
+	goto error_exit;
       *buf = work;
     }
-
-  gc_free (&gc);
   return true;
 
  error_exit:
   ERR_clear_error ();
   buf->len = 0;
-  gc_free (&gc);
   return false;
 }
 
+/*
+ * Decrypt n packets for the same peer back to back.  Packets
+ * which fail authentication or the replay check are left with
+ * len 0.  Return the number of packets successfully decrypted.
+ */
+int
+openvpn_decrypt_batch (struct buffer *bufs, struct buffer *work, int n,
+		       const struct crypto_options *opt,
+		       const struct frame* frame)
+{
+  int i, ok = 0;
+
+  for (i = 0; i < n; ++i)
+    if (openvpn_decrypt (&bufs[i], work[i], opt, frame))
+      ++ok;
+  return ok;
+}
+
 /*
  * How many bytes will we add to frame buffer for a given
  * set of crypto options?
@@ -392,6 +652,12 @@ crypto_adjust_frame_parameters(struct frame *frame,
 			       bool packet_id,
 			       bool packet_id_long_form)
 {
+  if (cipher_defined && cipher_kt_mode_aead (kt->cipher))
+    {
+      frame_add_to_extra_frame (frame, packet_id_size (false) + OPENVPN_AEAD_TAG_LENGTH);
+      return;
+    }
+
   frame_add_to_extra_frame (frame,
 			    (packet_id ? packet_id_size (packet_id_long_form) : 0) +
 			    ((cipher_defined && use_iv) ? EVP_CIPHER_iv_length (kt->cipher) : 0) +
@@ -508,20 +774,39 @@ init_key_type (struct key_type *kt, const char *ciphername,
       if (keysize > 0 && keysize <= MAX_CIPHER_KEY_LENGTH)
 	kt->cipher_length = keysize;
 
-      /* check legal cipher mode */
+      /*
+       * check legal cipher mode -- AEAD modes, like CFB and OFB,
+       * need TLS mode so that a key is never reused with a
+       * restarted packet ID sequence
+       */
       {
 	const unsigned int mode = EVP_CIPHER_mode (kt->cipher);
 	if (!(mode == EVP_CIPH_CBC_MODE
 #ifdef ALLOW_NON_CBC_CIPHERS
 	      || (cfb_ofb_allowed && (mode == EVP_CIPH_CFB_MODE || mode == EVP_CIPH_OFB_MODE))
 #endif
+	      || (cfb_ofb_allowed && cipher_kt_mode_aead (kt->cipher))
 	      ))
 #ifdef ENABLE_SMALL
 	  msg (M_FATAL, "Cipher '%s' mode not supported", ciphername);
 #else
-	  msg (M_FATAL, "Cipher '%s' uses a mode not supported by " PACKAGE_NAME " in your current configuration.  CBC mode is always supported, while CFB and OFB modes are supported only when using SSL/TLS authentication and key exchange mode, and when " PACKAGE_NAME " has been built with ALLOW_NON_CBC_CIPHERS.", ciphername);
+	  msg (M_FATAL, "Cipher '%s' uses a mode not supported by " PACKAGE_NAME " in your current configuration.  CBC mode is always supported, while AEAD (GCM), CFB and OFB modes are supported only when using SSL/TLS authentication and key exchange mode, and CFB and OFB modes only when " PACKAGE_NAME " has been built with ALLOW_NON_CBC_CIPHERS.", ciphername);
 #endif
       }
+
+      /*
+       * AEAD ciphers authenticate the packet themselves, so
+       * no HMAC is used; the HMAC key holds the implicit IV.
+       */
+      if (cipher_kt_mode_aead (kt->cipher))
+	{
+	  const int iv_len = EVP_CIPHER_iv_length (kt->cipher);
+	  if (iv_len <= (int) sizeof (packet_id_type)
+	      || iv_len - (int) sizeof (packet_id_type) > MAX_HMAC_KEY_LENGTH)
+	    msg (M_FATAL, "Cipher '%s' has an unsupported IV length (%d bytes)", ciphername, iv_len);
+	  kt->hmac_length = iv_len - sizeof (packet_id_type);
+	  return;
+	}
     }
   else
     {
@@ -580,11 +865,21 @@ init_key_ctx (struct key_ctx *ctx, struct key *key,
     {
       ALLOC_OBJ (ctx->cipher, EVP_CIPHER_CTX);
       init_cipher (ctx->cipher, kt->cipher, key, kt, enc, prefix);
+      ctx->cipher_mode = EVP_CIPHER_CTX_mode (ctx->cipher);
+      ctx->cipher_iv_len = EVP_CIPHER_CTX_iv_length (ctx->cipher);
+      ctx->cipher_block_size = EVP_CIPHER_CTX_block_size (ctx->cipher);
     }
   if (kt->digest && kt->hmac_length > 0)
     {
       ALLOC_OBJ (ctx->hmac, HMAC_CTX);
       init_hmac (ctx->hmac, kt->digest, key, kt, prefix);
+      ctx->hmac_len = HMAC_size (ctx->hmac);
+    }
+  if (ctx->cipher && cipher_kt_mode_aead (kt->cipher))
+    {
+      ctx->implicit_iv_len = kt->hmac_length;
+      memcpy (ctx->implicit_iv, key->hmac, ctx->implicit_iv_len);
+      msg (D_HANDSHAKE, "%s: Using AEAD mode, cipher authenticates packets", prefix);
     }
 }
 
@@ -603,6 +898,8 @@ free_key_ctx (struct key_ctx *ctx)
       free (ctx->hmac);
       ctx->hmac = NULL;
     }
+  CLEAR (ctx->implicit_iv);
+  ctx->implicit_iv_len = 0;
 }
 
 void
@@ -769,6 +1066,8 @@ check_replay_iv_consistency (const struct key_type *kt, bool packet_id, bool use
 {
   if (cfb_ofb_mode (kt) && !(packet_id && use_iv))
     msg (M_FATAL, "--no-replay or --no-iv cannot be used with a CFB or OFB mode cipher");
+  if (cipher_kt_mode_aead (kt->cipher) && !packet_id)
+    msg (M_FATAL, "--no-replay cannot be used with an AEAD mode cipher");
 }
 
 bool
@@ -1487,6 +1786,7 @@ show_available_ciphers ()
 #ifdef ALLOW_NON_CBC_CIPHERS
 	      || mode == EVP_CIPH_CFB_MODE || mode == EVP_CIPH_OFB_MODE
 #endif
+	      || cipher_kt_mode_aead (cipher)
 	      )
 	    printf ("%s %d bit default key (%s)\n",
 		    OBJ_nid2sn (nid),
@@ -1656,6 +1956,21 @@ static uint8_t *nonce_data; /* GLOBAL */
 static const EVP_MD *nonce_md = NULL; /* GLOBAL */
 static int nonce_secret_len; /* GLOBAL */
 
+/*
+ * prng_bytes output is buffered.  PRNG_POOL_SIZE bytes at a
+ * time are generated by AES-128 in counter mode, with key and
+ * counter drawn from the digest chain above at every refill, so
+ * that most calls (one per packet for CBC IVs) are a memcpy.
+ * Bytes are erased from the pool once handed out.
+ */
+#if SSLEAY_VERSION_NUMBER >= 0x00907000L && !defined(OPENSSL_NO_AES)
+#define PRNG_POOL
+#define PRNG_POOL_SIZE 1024
+
+static uint8_t prng_pool[PRNG_POOL_SIZE]; /* GLOBAL */
+static int prng_pool_avail; /* GLOBAL */
+#endif
+
 void
 prng_init (const char *md_name, const int nonce_secret_len_parm)
 {
@@ -1692,28 +2007,89 @@ prng_uninit (void)
   nonce_data = NULL;
   nonce_md = NULL;
   nonce_secret_len = 0;
+#ifdef PRNG_POOL
+  CLEAR (prng_pool);
+  prng_pool_avail = 0;
+#endif
 }
 
+static void
+prng_digest_bytes (uint8_t *output, int len)
+{
+  EVP_MD_CTX ctx;
+  const int md_size = EVP_MD_size (nonce_md);
+  while (len > 0)
+    {
+      unsigned int outlen = 0;
+      const int blen = min_int (len, md_size);
+      EVP_DigestInit (&ctx, nonce_md);
+      EVP_DigestUpdate (&ctx, nonce_data, md_size + nonce_secret_len);
+      EVP_DigestFinal (&ctx, nonce_data, &outlen);
+      ASSERT (outlen == md_size);
+      EVP_MD_CTX_cleanup (&ctx);
+      memcpy (output, nonce_data, blen);
+      output += blen;
+      len -= blen;
+    }
+}
+
+#ifdef PRNG_POOL
+
+static void
+prng_pool_refill (void)
+{
+  EVP_CIPHER_CTX ctx;
+  uint8_t key[16];
+  uint8_t ctr[16];
+  int i, j, outlen;
+
+  prng_digest_bytes (key, sizeof (key));
+  prng_digest_bytes (ctr, sizeof (ctr));
+
+  /* lay out successive counter blocks, then encrypt them in one call */
+  for (i = 0; i < PRNG_POOL_SIZE; i += sizeof (ctr))
+    {
+      memcpy (prng_pool + i, ctr, sizeof (ctr));
+      for (j = sizeof (ctr) - 1; j >= 0 && !++ctr[j]; --j)
+	;
+    }
+
+  EVP_CIPHER_CTX_init (&ctx);
+  ASSERT (EVP_CipherInit_ov (&ctx, EVP_aes_128_ecb (), key, NULL, DO_ENCRYPT));
+  ASSERT (EVP_CipherUpdate_ov (&ctx, prng_pool, &outlen, prng_pool, PRNG_POOL_SIZE));
+  ASSERT (outlen == PRNG_POOL_SIZE);
+  EVP_CIPHER_CTX_cleanup (&ctx);
+  CLEAR (key);
+
+  prng_pool_avail = PRNG_POOL_SIZE;
+}
+
+#endif
+
 void
 prng_bytes (uint8_t *output, int len)
 {
   if (nonce_md)
     {
-      EVP_MD_CTX ctx;
-      const int md_size = EVP_MD_size (nonce_md);
+#ifdef PRNG_POOL
       while (len > 0)
 	{
-	  unsigned int outlen = 0;
-	  const int blen = min_int (len, md_size);
-	  EVP_DigestInit (&ctx, nonce_md);
-	  EVP_DigestUpdate (&ctx, nonce_data, md_size + nonce_secret_len);
-	  EVP_DigestFinal (&ctx, nonce_data, &outlen);
-	  ASSERT (outlen == md_size);
-	  EVP_MD_CTX_cleanup (&ctx);
-	  memcpy (output, nonce_data, blen);
+	  uint8_t *p;
+	  int blen;
+
+	  if (!prng_pool_avail)
+	    prng_pool_refill ();
+	  p = prng_pool + PRNG_POOL_SIZE - prng_pool_avail;
+	  blen = min_int (len, prng_pool_avail);
+	  memcpy (output, p, blen);
+	  memset (p, 0, blen);
+	  prng_pool_avail -= blen;
 	  output += blen;
 	  len -= blen;
 	}
+#else
+      prng_digest_bytes (output, len);
+#endif
     }
   else
     RAND_bytes (output, len);
@@ -165,6 +165,24 @@ cipher_ok (const char* name)
 #define EVP_MD_name(e)			OBJ_nid2sn(EVP_MD_type(e))
 #endif
 
+/*
+ * AEAD cipher modes (AES-GCM, ChaCha20-Poly1305) need
+ * OpenSSL 1.0.1 or later.
+ */
+#ifdef EVP_CIPH_FLAG_AEAD_CIPHER
+#define HAVE_AEAD_CIPHER_MODES
+#endif
+
+static inline bool
+cipher_kt_mode_aead (const EVP_CIPHER *cipher)
+{
+#ifdef HAVE_AEAD_CIPHER_MODES
+  return cipher && (EVP_CIPHER_flags (cipher) & EVP_CIPH_FLAG_AEAD_CIPHER);
+#else
+  return false;
+#endif
+}
+
 /*
  * Max size in bytes of any cipher key that might conceivably be used.
  *
@@ -188,6 +206,26 @@ cipher_ok (const char* name)
  */
 #define MAX_HMAC_KEY_LENGTH 64
 
+/*
+ * AEAD data channel packets are
+ *
+ *   [packet ID] [tag] [ciphertext]
+ *
+ * where the short-form packet ID is authenticated as additional
+ * data, and the nonce is the packet ID followed by an implicit
+ * IV taken from the (otherwise unused) HMAC part of the key.
+ *
+ * The opcode/key-id byte put in front in TLS mode is left out
+ * of the additional data, as it is left out of the HMAC in CBC
+ * mode.  It only selects the key to decrypt with, and each
+ * key-id has its own keys and implicit IV, so a packet whose
+ * key-id was changed fails tag verification.  A packet whose
+ * opcode was changed is no longer a data packet and must pass
+ * the control channel checks instead.  --secret mode has no
+ * such byte.
+ */
+#define OPENVPN_AEAD_TAG_LENGTH 16
+
 /*
  * Defines a key type and key length for both cipher and HMAC.
  */
@@ -239,6 +277,16 @@ struct key_ctx
 {
   EVP_CIPHER_CTX *cipher;
   HMAC_CTX *hmac;
+
+  /* cipher and HMAC parameters, looked up once by init_key_ctx */
+  unsigned int cipher_mode;
+  int cipher_iv_len;
+  int cipher_block_size;
+  int hmac_len;
+
+  /* AEAD mode only */
+  int implicit_iv_len;		/* nonzero if cipher is an AEAD cipher */
+  uint8_t implicit_iv[EVP_MAX_IV_LENGTH];
 };
 
 /*
@@ -313,6 +361,13 @@ void init_key_ctx (struct key_ctx *ctx, struct key *key,
 void free_key_ctx (struct key_ctx *ctx);
 void free_key_ctx_bi (struct key_ctx_bi *ctx);
 
+/*
+ * Encrypt buf using work as the output buffer.  If work is
+ * buf's own storage (work.data == buf->data) the packet is
+ * encrypted in place and the IV/tag and HMAC are prepended
+ * into buf's headroom, so the caller must only do this for
+ * buffers initialized with FRAME_HEADROOM.
+ */
 void openvpn_encrypt (struct buffer *buf, struct buffer work,
 		      const struct crypto_options *opt,
 		      const struct frame* frame);
@@ -321,6 +376,20 @@ bool openvpn_decrypt (struct buffer *buf, struct buffer work,
 		      const struct crypto_options *opt,
 		      const struct frame* frame);
 
+/*
+ * Batched versions of the above, for a burst of packets
+ * to or from one peer.  work is an array of n workspaces.
+ */
+#define CRYPTO_BATCH_MAX 32
+
+void openvpn_encrypt_batch (struct buffer *bufs, struct buffer *work, int n,
+			    const struct crypto_options *opt,
+			    const struct frame* frame);
+
+int openvpn_decrypt_batch (struct buffer *bufs, struct buffer *work, int n,
+			   const struct crypto_options *opt,
+			   const struct frame* frame);
+
 
 void crypto_adjust_frame_parameters(struct frame *frame,
 				    const struct key_type* kt,
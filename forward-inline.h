@@ -251,15 +251,21 @@ register_activity (struct context *c, const int size)
 /*
  * Return the io_wait() flags appropriate for
  * a point-to-point tunnel.
+ *
+ * A TCP read can leave further complete packets in the
+ * stream buffer, but reading the next one would overwrite
+ * to_tun, so pending output is always flushed first.
  */
 static inline unsigned int
 p2p_iow_flags (const struct context *c)
 {
-  unsigned int flags = (IOW_SHAPER|IOW_CHECK_RESIDUAL|IOW_FRAG|IOW_READ|IOW_WAIT_SIGNAL);
+  unsigned int flags = (IOW_SHAPER|IOW_FRAG|IOW_READ|IOW_WAIT_SIGNAL);
   if (c->c2.to_link.len > 0)
     flags |= IOW_TO_LINK;
   if (c->c2.to_tun.len > 0)
     flags |= IOW_TO_TUN;
+  if (!(flags & (IOW_TO_LINK|IOW_TO_TUN)))
+    flags |= IOW_CHECK_RESIDUAL;
   return flags;
 }
 
@@ -33,6 +33,7 @@
 #include "ps.h"
 #include "dhcp.h"
 #include "common.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -460,9 +461,19 @@ encrypt_sign (struct context *c, bool comp_frag)
 
   /*
    * Encrypt the packet and write an optional
-   * HMAC signature.
+   * HMAC signature.  Packets still sitting in the tun read
+   * or compression buffer have FRAME_HEADROOM in front of
+   * them, so those are encrypted in place rather than
+   * copied through encrypt_buf.
    */
-  openvpn_encrypt (&c->c2.buf, b->encrypt_buf, &c->c2.crypto_options, &c->c2.frame);
+  if (c->c2.buf.data == b->read_tun_buf.data
+#ifdef USE_LZO
+      || c->c2.buf.data == b->lzo_compress_buf.data
+#endif
+      )
+    openvpn_encrypt (&c->c2.buf, c->c2.buf, &c->c2.crypto_options, &c->c2.frame);
+  else
+    openvpn_encrypt (&c->c2.buf, b->encrypt_buf, &c->c2.crypto_options, &c->c2.frame);
 #endif
   /*
    * Get the address we will be sending the packet to.
@@ -516,6 +527,12 @@ process_coarse_timers (struct context *c)
   pf_check_reload (c);
 #endif
 
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  /* pick up a changed --crl-verify file (server mode does this in multi_process_per_second_timers) */
+  if (c->c1.ks.crl_index && c->options.mode == MODE_POINT_TO_POINT)
+    crl_index_update (c->c1.ks.crl_index);
+#endif
+
   /* process --route options */
   check_add_routes (c);
 
@@ -739,6 +756,7 @@ process_incoming_link (struct context *c)
     {
       c->c2.link_read_bytes += c->c2.buf.len;
       link_read_bytes_global += c->c2.buf.len;
+      ++metrics.link_read_packets;
       c->c2.original_recv_size = c->c2.buf.len;
 #ifdef ENABLE_MANAGEMENT
       if (management)
@@ -963,7 +981,11 @@ process_incoming_tun (struct context *c)
   perf_push (PERF_PROC_IN_TUN);
 
   if (c->c2.buf.len > 0)
-    c->c2.tun_read_bytes += c->c2.buf.len;
+    {
+      c->c2.tun_read_bytes += c->c2.buf.len;
+      metrics.tun_read_bytes += c->c2.buf.len;
+      ++metrics.tun_read_packets;
+    }
 
 #ifdef LOG_RW
   if (c->c2.log_rw && c->c2.buf.len > 0)
@@ -1132,6 +1154,7 @@ process_outgoing_link (struct context *c)
 	      c->c2.max_send_size_local = max_int (size, c->c2.max_send_size_local);
 	      c->c2.link_write_bytes += size;
 	      link_write_bytes_global += size;
+	      ++metrics.link_write_packets;
 #ifdef ENABLE_MANAGEMENT
 	      if (management)
 		{
@@ -1177,6 +1200,70 @@ process_outgoing_link (struct context *c)
   gc_free (&gc);
 }
 
+#if TCP_WRITEV_CAPABILITY
+
+/*
+ * Write n queued, already encrypted packets to a TCP link
+ * with one system call.  *partial is the number of bytes of
+ * bufs[0] (counting its length prefix) sent by an earlier
+ * short write, and is updated for the next call.
+ * Returns the number of packets completely written.
+ */
+int
+process_outgoing_link_tcp_batch (struct context *c, struct buffer *const *bufs, const int n, int *partial)
+{
+  int size;
+  int done = 0;
+
+  perf_push (PERF_PROC_OUT_LINK);
+
+  size = link_socket_write_tcp_batch (c->c2.link_socket, bufs, n, *partial);
+
+  check_status (size, "write", c->c2.link_socket, NULL);
+
+  if (size > 0)
+    {
+      int left = *partial + size;
+
+      while (done < n && left >= BLEN (bufs[done]) + (int) sizeof (packet_size_type))
+	left -= BLEN (bufs[done++]) + sizeof (packet_size_type);
+      *partial = left;
+
+      msg (D_LINK_RW, "%s WRITE [%d] %d packets%s",
+	   proto2ascii (c->c2.link_socket->info.proto, true),
+	   size,
+	   done,
+	   left ? ", partial" : "");
+
+#ifdef HAVE_GETTIMEOFDAY
+      if (c->options.shaper)
+	shaper_wrote_bytes (&c->c2.shaper, size + datagram_overhead (c->options.ce.proto));
+#endif
+      if (c->options.ping_send_timeout)
+	event_timeout_reset (&c->c2.ping_send_interval);
+
+      c->c2.max_send_size_local = max_int (size, c->c2.max_send_size_local);
+      c->c2.link_write_bytes += size;
+      link_write_bytes_global += size;
+      metrics.link_write_packets += done;
+#ifdef ENABLE_MANAGEMENT
+      if (management)
+	{
+	  management_bytes_out (management, size);
+#ifdef MANAGEMENT_DEF_AUTH
+	  management_bytes_server (management, &c->c2.link_read_bytes, &c->c2.link_write_bytes, &c->c2.mda_context);
+#endif
+	}
+#endif
+      register_activity (c, size);
+    }
+
+  perf_pop ();
+  return done;
+}
+
+#endif
+
 /*
  * Input: c->c2.to_tun
  */
@@ -1229,7 +1316,11 @@ process_outgoing_tun (struct context *c)
 #endif
 
       if (size > 0)
-	c->c2.tun_write_bytes += size;
+	{
+	  c->c2.tun_write_bytes += size;
+	  metrics.tun_write_bytes += size;
+	  ++metrics.tun_write_packets;
+	}
       check_status (size, "write to TUN/TAP", NULL, c->c1.tuntap);
 
       /* check written packet size */
@@ -1491,6 +1582,39 @@ io_wait_dowork (struct context *c, const unsigned int flags)
   dmsg (D_EVENT_WAIT, "I/O WAIT status=0x%04x", c->c2.event_set_status);
 }
 
+/*
+ * Once a TUN/TAP read wakes us up, keep the tun -> link
+ * path moving without going back through io_wait() for
+ * every packet: send the packet we just encrypted, then
+ * read the next one from the non-blocking TUN/TAP device,
+ * until it is drained or TUN_READ_BURST packets have
+ * been moved.  Only used with --fast-io, where UDP writes
+ * never wait on the event loop anyway.
+ */
+static void
+process_tun_burst (struct context *c)
+{
+  int n;
+
+  if (TO_LINK_FRAG (c))
+    return;
+
+  for (n = 1; n < TUN_READ_BURST; ++n)
+    {
+      if (IS_SIG (c) || !LINK_OUT (c) || TUN_OUT (c))
+	break;
+      process_outgoing_link (c);
+      if (IS_SIG (c) || LINK_OUT (c))
+	break;
+      read_incoming_tun (c);
+      if (IS_SIG (c))
+	break;
+      process_incoming_tun (c);
+      if (TO_LINK_FRAG (c))
+	break;
+    }
+}
+
 void
 process_io (struct context *c)
 {
@@ -1527,5 +1651,193 @@ process_io (struct context *c)
       read_incoming_tun (c);
       if (!IS_SIG (c))
 	process_incoming_tun (c);
+      if (c->c2.fast_io)
+	process_tun_burst (c);
+    }
+}
+
+#ifdef TCP_STREAM_TEST
+
+/*
+ * Write back-to-back packets to a TCP-like stream in one go,
+ * so that a single recv() picks up many of them.
+ *
+ * The point-to-point run feeds them through the read/write
+ * decisions of io_wait_dowork() and process_io(), and through
+ * the buffer_turnover() of an unencrypted
+ * process_incoming_link(), with a TUN device that always
+ * accepts writes.  A fully formed packet left in the stream
+ * buffer must never be read while the previous one is still
+ * waiting in to_tun.
+ *
+ * The server run reads from two instances that share the
+ * read area, alternating after every packet, so that unread
+ * data keeps moving between the shared and own buffers.  Each
+ * packet is only checked after the next read has been set up.
+ */
+
+#define TCP_STREAM_TEST_N      256
+#define TCP_STREAM_TEST_MAXLEN 1500
+#define TCP_STREAM_TEST_SOCKS  2
+
+static int
+tcp_stream_test_len (const int i)
+{
+  return 20 + (i * 37) % 1400;
+}
+
+/* returns the writing end of the stream */
+static int
+tcp_stream_test_open (struct link_socket *sock, struct buffer *stream, const bool shared)
+{
+  struct buffer wire = alloc_buf (TCP_STREAM_TEST_N * (TCP_STREAM_TEST_MAXLEN + 2));
+  int sv[2];
+  int i;
+
+  CLEAR (*sock);
+  ASSERT (!socketpair (PF_UNIX, SOCK_STREAM, 0, sv));
+  sock->sd = sv[0];
+  sock->info.proto = shared ? PROTO_TCPv4_SERVER : PROTO_TCPv4_CLIENT;
+  *stream = alloc_buf (TCP_STREAM_TEST_MAXLEN + (shared ? 0 : STREAM_BUF_READ_SIZE));
+  stream->len = TCP_STREAM_TEST_MAXLEN;
+  stream_buf_init (&sock->stream_buf, stream, 0, sock->info.proto);
+  if (shared)
+    stream_buf_share (&sock->stream_buf, TCP_STREAM_TEST_MAXLEN + STREAM_BUF_READ_SIZE);
+
+  /* packet i carries its number */
+  for (i = 0; i < TCP_STREAM_TEST_N; ++i)
+    {
+      const int len = tcp_stream_test_len (i);
+      ASSERT (buf_write_u16 (&wire, len));
+      ASSERT (buf_write_u32 (&wire, i));
+      ASSERT (buf_safe (&wire, len - 4));
+      memset (BEND (&wire), i & 0xFF, len - 4);
+      ASSERT (buf_inc_len (&wire, len - 4));
+    }
+  ASSERT (send (sv[1], BPTR (&wire), BLEN (&wire), MSG_NOSIGNAL) == BLEN (&wire));
+  free_buf (&wire);
+  stream_buf_read_setup (sock);
+  return sv[1];
+}
+
+static void
+tcp_stream_test_close (struct link_socket *sock, struct buffer *stream, const int peer)
+{
+  stream_buf_close (&sock->stream_buf);
+  free_buf (stream);
+  close (sock->sd);
+  close (peer);
+}
+
+static void
+tcp_stream_test_check (const char *name, const struct buffer *buf, const int i)
+{
+  struct buffer pkt = *buf;
+  bool good;
+  if (buf_read_u32 (&pkt, &good) != i || !good
+      || BLEN (buf) != tcp_stream_test_len (i)
+      || BPTR (&pkt)[0] != (i & 0xFF) || BPTR (&pkt)[BLEN (&pkt) - 1] != (i & 0xFF))
+    msg (M_FATAL, "TCP_STREAM_TEST %s: packet %d corrupted or out of order", name, i);
+}
+
+static void
+tcp_stream_test_p2p (void)
+{
+  struct context c;
+  struct link_socket sock;
+  struct buffer stream, storage;
+  int peer;
+  int written = 0;
+  int recvs = 0;
+
+  CLEAR (c);
+  peer = tcp_stream_test_open (&sock, &stream, false);
+  c.c2.link_socket = &sock;
+  storage = alloc_buf (TCP_STREAM_TEST_MAXLEN);
+
+  while (written < TCP_STREAM_TEST_N)
+    {
+      const unsigned int flags = p2p_iow_flags (&c);
+
+      if ((flags & IOW_CHECK_RESIDUAL) && socket_read_residual (&sock))
+	; /* SOCKET_READ without waiting */
+      else if (flags & IOW_TO_TUN)
+	{
+	  tcp_stream_test_check ("P2P", &c.c2.to_tun, written++);
+	  buf_reset (&c.c2.to_tun);
+	  continue;
+	}
+      else
+	{
+	  ASSERT (stream_buf_read_setup (&sock));
+	  ++recvs;
+	}
+
+      ASSERT (link_socket_read_tcp (&sock, &c.c2.buf) >= 0);
+      if (c.c2.buf.len > 0)
+	{
+	  if (c.c2.to_tun.len > 0)
+	    msg (M_FATAL, "TCP_STREAM_TEST P2P: packet %d overwritten before it was written", written);
+	  buffer_turnover (c.c2.buf.data, &c.c2.to_tun, &c.c2.buf, &storage);
+	}
+    }
+
+  printf ("TCP_STREAM_TEST P2P: %d packets, %d recv calls\n", written, recvs);
+  free_buf (&storage);
+  tcp_stream_test_close (&sock, &stream, peer);
+}
+
+static void
+tcp_stream_test_server (void)
+{
+  struct link_socket socks[TCP_STREAM_TEST_SOCKS];
+  struct buffer streams[TCP_STREAM_TEST_SOCKS];
+  int peers[TCP_STREAM_TEST_SOCKS];
+  int next[TCP_STREAM_TEST_SOCKS];
+  int recvs = 0;
+  int done = 0;
+  int i;
+
+  for (i = 0; i < TCP_STREAM_TEST_SOCKS; ++i)
+    {
+      peers[i] = tcp_stream_test_open (&socks[i], &streams[i], true);
+      next[i] = 0;
+    }
+
+  for (i = 0; done < TCP_STREAM_TEST_SOCKS; i = (i + 1) % TCP_STREAM_TEST_SOCKS)
+    {
+      struct link_socket *sock = &socks[i];
+      struct buffer buf;
+
+      if (next[i] == TCP_STREAM_TEST_N)
+	continue;
+
+      /* read until one packet is complete */
+      do {
+	if (!socket_read_residual (sock))
+	  ++recvs;
+	ASSERT (link_socket_read_tcp (sock, &buf) >= 0);
+
+	/* multi_tcp_dispatch() sets up the next read before the TUN write */
+	stream_buf_read_setup (sock);
+      } while (buf.len <= 0);
+
+      tcp_stream_test_check ("SERVER", &buf, next[i]);
+      if (++next[i] == TCP_STREAM_TEST_N)
+	++done;
     }
+
+  printf ("TCP_STREAM_TEST SERVER: %d instances, %d packets each, %d recv calls\n",
+	  TCP_STREAM_TEST_SOCKS, TCP_STREAM_TEST_N, recvs);
+  for (i = 0; i < TCP_STREAM_TEST_SOCKS; ++i)
+    tcp_stream_test_close (&socks[i], &streams[i], peers[i]);
 }
+
+void
+tcp_stream_test (void)
+{
+  tcp_stream_test_p2p ();
+  tcp_stream_test_server ();
+}
+
+#endif /* TCP_STREAM_TEST */
@@ -54,6 +54,12 @@
 
 #define IOW_READ            (IOW_READ_TUN|IOW_READ_LINK)
 
+/*
+ * With --fast-io, max number of packets moved from the
+ * TUN/TAP device to the link per event loop wakeup.
+ */
+#define TUN_READ_BURST      32
+
 void pre_select (struct context *c);
 
 void process_io (struct context *c);
@@ -68,6 +74,9 @@ void process_incoming_link (struct context *c);
 void read_incoming_tun (struct context *c);
 void process_incoming_tun (struct context *c);
 void process_outgoing_link (struct context *c);
+#if TCP_WRITEV_CAPABILITY
+int process_outgoing_link_tcp_batch (struct context *c, struct buffer *const *bufs, const int n, int *partial);
+#endif
 void process_outgoing_tun (struct context *c);
 
 bool send_control_channel_string (struct context *c, const char *str, int msglevel);
@@ -83,4 +92,8 @@ void process_ipv4_header (struct context *c, unsigned int flags, struct buffer *
 void schedule_exit (struct context *c, const int n_seconds, const int signal);
 #endif
 
+#ifdef TCP_STREAM_TEST
+void tcp_stream_test (void);
+#endif
+
 #endif /* FORWARD_H */
@@ -111,6 +111,16 @@ fragment_free (struct fragment_master *f)
   free (f);
 }
 
+size_t
+fragment_memory (const struct fragment_master *f)
+{
+  size_t ret = sizeof (*f) + f->outgoing.capacity + f->outgoing_return.capacity;
+  int i;
+  for (i = 0; i < N_FRAG_BUF; ++i)
+    ret += f->incoming.fragments[i].buf.capacity;
+  return ret;
+}
+
 void
 fragment_frame_init (struct fragment_master *f, const struct frame *frame)
 {
@@ -153,6 +153,9 @@ void fragment_frame_init (struct fragment_master *f, const struct frame *frame);
 
 void fragment_free (struct fragment_master *f);
 
+/* heap bytes held by f */
+size_t fragment_memory (const struct fragment_master *f);
+
 void fragment_incoming (struct fragment_master *f, struct buffer *buf,
 			const struct frame* frame);
 
@@ -29,6 +29,7 @@
 #include "sig.h"
 #include "occ.h"
 #include "list.h"
+#include "ring.h"
 #include "otime.h"
 #include "pool.h"
 #include "gremlin.h"
@@ -581,6 +582,16 @@ init_static (void)
   return false;
 #endif
 
+#ifdef RING_TEST
+  ring_test ();
+  return false;
+#endif
+
+#ifdef TCP_STREAM_TEST
+  tcp_stream_test ();
+  return false;
+#endif
+
 #ifdef IFCONFIG_POOL_TEST
   ifconfig_pool_test (0x0A010004, 0x0A0100FF);
   return false;
@@ -953,6 +964,11 @@ format_common_name (struct context *c, struct gc_arena *gc)
 void
 pre_setup (const struct options *options)
 {
+#ifdef ENABLE_PERFORMANCE_METRICS
+  if (options->perf_stats)
+    perf_enable (true);
+#endif
+
 #ifdef WIN32
   if (options->exit_event_name)
     {
@@ -1582,7 +1598,7 @@ do_deferred_options (struct context *c, const unsigned int found)
       if (lzo_defined (&c->c2.lzo_compwork))
 	{
 	  msg (D_PUSH, "OPTIONS IMPORT: LZO parms modified");
-	  lzo_modify_flags (&c->c2.lzo_compwork, c->options.lzo);
+	  lzo_modify_flags (&c->c2.lzo_compwork, c->options.lzo, c->options.comp_alg);
 	}
     }
 #endif
@@ -1756,6 +1772,8 @@ key_schedule_free (struct key_schedule *ks, bool free_ssl_ctx)
     {
       SSL_CTX_free (ks->ssl_ctx);
       free_key_ctx_bi (&ks->tls_auth_key);
+      crl_index_free (ks->crl_index);
+      verify_cache_free (ks->verify_cache);
     }
 #endif /* USE_SSL */
 #endif /* USE_CRYPTO */
@@ -1793,7 +1811,7 @@ static void
 do_init_crypto_static (struct context *c, const unsigned int flags)
 {
   const struct options *options = &c->options;
-  ASSERT (options->shared_secret_file);
+  ASSERT (options->shared_secret_file || options->benchmark_packets);
 
   init_crypto_pre (c, flags);
 
@@ -1820,24 +1838,40 @@ do_init_crypto_static (struct context *c, const unsigned int flags)
 		     options->authname_defined, options->keysize,
 		     options->test_crypto, true);
 
-      /* Read cipher and hmac keys from shared secret file */
-      {
-	unsigned int rkf_flags = RKF_MUST_SUCCEED;
-	const char *rkf_file = options->shared_secret_file;
+      if (options->shared_secret_file)
+	{
+	  /* Read cipher and hmac keys from shared secret file */
+	  unsigned int rkf_flags = RKF_MUST_SUCCEED;
+	  const char *rkf_file = options->shared_secret_file;
 
 #if ENABLE_INLINE_FILES
-	if (options->shared_secret_file_inline)
-	  {
-	    rkf_file = options->shared_secret_file_inline;
-	    rkf_flags |= RKF_INLINE;
-	  }
+	  if (options->shared_secret_file_inline)
+	    {
+	      rkf_file = options->shared_secret_file_inline;
+	      rkf_flags |= RKF_INLINE;
+	    }
 #endif
-	read_key_file (&key2, rkf_file, rkf_flags);
-      }
+	  read_key_file (&key2, rkf_file, rkf_flags);
 
-      /* Check for and fix highly unlikely key problems */
-      verify_fix_key2 (&key2, &c->c1.ks.key_type,
-		       options->shared_secret_file);
+	  /* Check for and fix highly unlikely key problems */
+	  verify_fix_key2 (&key2, &c->c1.ks.key_type,
+			   options->shared_secret_file);
+	}
+      else
+	{
+	  /*
+	   * --benchmark without --secret: use a throwaway random
+	   * key, the same in both directions so that packets
+	   * decrypt whatever --key-direction says.  This is also
+	   * how AEAD ciphers, which --secret does not allow, get
+	   * benchmarked.
+	   */
+	  CLEAR (key2);
+	  key2.n = 2;
+	  generate_key_random (&key2.keys[0], &c->c1.ks.key_type);
+	  key2.keys[1] = key2.keys[0];
+	  msg (M_INFO, "Using a random key for --benchmark");
+	}
 
       /* Initialize OpenSSL key objects */
       key_direction_state_init (&kds, options->key_direction);
@@ -1919,6 +1953,15 @@ do_init_crypto_tls_c1 (struct context *c)
       /* Initialize PRNG with config-specified digest */
       prng_init (options->prng_hash, options->prng_nonce_secret_len);
 
+      /* Revoked serial numbers, loaded now and reloaded from the coarse timers */
+      if (options->crl_file)
+	c->c1.ks.crl_index = crl_index_new (options->crl_file);
+
+      /* Cache of verified peer certificate chains */
+      if (options->verify_cache_size)
+	c->c1.ks.verify_cache = verify_cache_new (options->verify_cache_size,
+						  options->verify_cache_ttl);
+
       /* TLS handshake authentication (--tls-auth) */
       if (options->tls_auth_file)
 	{
@@ -2005,9 +2048,12 @@ do_init_crypto_tls (struct context *c, const unsigned int flags)
   to.transition_window = options->transition_window;
   to.handshake_window = options->handshake_window;
   to.packet_timeout = options->tls_timeout;
+  to.reliable_window = options->tls_window;
   to.renegotiate_bytes = options->renegotiate_bytes;
   to.renegotiate_packets = options->renegotiate_packets;
   to.renegotiate_seconds = options->renegotiate_seconds;
+  to.renegotiate_jitter = options->renegotiate_jitter;
+  to.renegotiate_max_rate = options->renegotiate_max_rate;
   to.single_session = options->single_session;
 #ifdef ENABLE_PUSH_PEER_INFO
   to.push_peer_info = options->push_peer_info;
@@ -2026,6 +2072,8 @@ do_init_crypto_tls (struct context *c, const unsigned int flags)
   to.verify_export_cert = options->tls_export_cert;
   to.verify_x509name = options->tls_remote;
   to.crl_file = options->crl_file;
+  to.crl_index = c->c1.ks.crl_index;
+  to.verify_cache = c->c1.ks.verify_cache;
   to.ns_cert_type = options->ns_cert_type;
   memmove (to.remote_cert_ku, options->remote_cert_ku, sizeof (to.remote_cert_ku));
   to.remote_cert_eku = options->remote_cert_eku;
@@ -3179,7 +3227,8 @@ init_instance (struct context *c, const struct env_set *env, const unsigned int
 #ifdef USE_LZO
   /* initialize LZO compression library. */
   if ((options->lzo & LZO_SELECTED) && (c->mode == CM_P2P || child))
-    lzo_compress_init (&c->c2.lzo_compwork, options->lzo);
+    lzo_compress_init (&c->c2.lzo_compwork, options->lzo, options->comp_alg,
+		       dev_type_enum (options->dev, options->dev_type));
 #endif
 
   /* initialize MTU variables */
@@ -3382,6 +3431,8 @@ inherit_context_child (struct context *dest,
 #ifdef USE_SSL
   /* inherit SSL context */
   dest->c1.ks.ssl_ctx = src->c1.ks.ssl_ctx;
+  dest->c1.ks.crl_index = src->c1.ks.crl_index;
+  dest->c1.ks.verify_cache = src->c1.ks.verify_cache;
   dest->c1.ks.tls_auth_key = src->c1.ks.tls_auth_key;
 #endif
 #endif
@@ -3503,6 +3554,174 @@ close_context (struct context *c, int sig, unsigned int flags)
 
 #ifdef USE_CRYPTO
 
+/*
+ * --benchmark: run batches of packets through the per-packet
+ * stages of the data channel (compress, encrypt+HMAC,
+ * HMAC verify+decrypt+replay check, decompress), timing each
+ * stage over the whole batch, and print the results as CSV to
+ * stderr or the --benchmark-output file, so that they don't get
+ * mixed up with log messages on stdout.
+ */
+
+#define BENCH_COMPRESS    0
+#define BENCH_ENCRYPT     1
+#define BENCH_DECRYPT     2
+#define BENCH_DECOMPRESS  3
+#define BENCH_TOTAL       4
+#define BENCH_N           5
+
+#define BENCH_BATCH       64
+
+static const char *bench_stage_names[BENCH_N] = {
+  "compress", "encrypt", "decrypt", "decompress", "total"
+};
+
+static void
+bench_print (FILE *fp, int size, int stage, int packets, double usec)
+{
+  const double pps = usec > 0 ? packets * 1000000.0 / usec : 0;
+  fprintf (fp, "%d,%s,%d,%.1f,%.0f,%.3f\n",
+	   size,
+	   bench_stage_names[stage],
+	   packets,
+	   usec * 1000.0 / packets,
+	   pps,
+	   pps * size * 8 / 1000000000.0);
+}
+
+static void
+benchmark_data_channel (struct context *c)
+{
+  static const int default_sizes[] = { 64, 512, 1400 };
+  const struct options *o = &c->options;
+  const struct frame *frame = &c->c2.frame;
+  const int *sizes = o->benchmark_sizes;
+  int n_sizes = o->benchmark_n_sizes;
+  struct gc_arena gc = gc_new ();
+  struct buffer payload = alloc_buf_gc (TUN_MTU_SIZE (frame), &gc);
+  struct buffer in[BENCH_BATCH];
+  struct buffer pkt[BENCH_BATCH];
+  struct buffer encrypt_work[BENCH_BATCH];
+  struct buffer decrypt_work[BENCH_BATCH];
+#ifdef USE_LZO
+  struct buffer compress_work[BENCH_BATCH];
+  struct buffer decompress_work[BENCH_BATCH];
+  const bool comp = lzo_defined (&c->c2.lzo_compwork);
+#else
+  const bool comp = false;
+#endif
+  FILE *fp = stderr;
+  int i, s;
+
+  if (!n_sizes)
+    {
+      sizes = default_sizes;
+      n_sizes = SIZE (default_sizes);
+    }
+
+  for (i = 0; i < BENCH_BATCH; ++i)
+    {
+      in[i] = alloc_buf_gc (BUF_SIZE (frame), &gc);
+      encrypt_work[i] = alloc_buf_gc (BUF_SIZE (frame), &gc);
+      decrypt_work[i] = alloc_buf_gc (BUF_SIZE (frame), &gc);
+#ifdef USE_LZO
+      compress_work[i] = alloc_buf_gc (BUF_SIZE (frame), &gc);
+      decompress_work[i] = alloc_buf_gc (BUF_SIZE (frame), &gc);
+#endif
+    }
+
+  if (o->benchmark_output)
+    {
+      fp = fopen (o->benchmark_output, "w");
+      if (!fp)
+	msg (M_ERR, "Open error on --benchmark-output file %s", o->benchmark_output);
+    }
+
+  msg (M_INFO, "Entering " PACKAGE_NAME " benchmark mode.");
+  fprintf (fp, "# cipher=%s auth=%s comp=%s replay-window=%d packets=%d\n",
+	   o->ciphername_defined ? o->ciphername : "none",
+	   c->c1.ks.key_type.digest ? o->authname : "none",
+	   comp ? "yes" : "no",
+	   o->replay ? o->replay_window : 0,
+	   o->benchmark_packets);
+  fprintf (fp, "size,stage,packets,ns_per_packet,packets_per_sec,gbit_per_sec\n");
+
+  for (s = 0; s < n_sizes; ++s)
+    {
+      const int size = sizes[s];
+      double usec[BENCH_N];
+      int done = 0;
+
+      if (size > TUN_MTU_SIZE (frame))
+	msg (M_FATAL, "BENCHMARK: packet size %d exceeds --tun-mtu %d", size, TUN_MTU_SIZE (frame));
+      CLEAR (usec);
+
+      /*
+       * Random data from a small alphabet, so that compression,
+       * if enabled, has something to do.
+       */
+      ASSERT (buf_init (&payload, 0));
+      ASSERT (RAND_pseudo_bytes (BPTR (&payload), size));
+      for (i = 0; i < size; ++i)
+	BPTR (&payload)[i] = 'a' + (BPTR (&payload)[i] & 0x0F);
+      payload.len = size;
+
+      while (done < o->benchmark_packets)
+	{
+	  const int n = min_int (BENCH_BATCH, o->benchmark_packets - done);
+	  struct timeval t[BENCH_N];
+
+	  update_time ();
+	  for (i = 0; i < n; ++i)
+	    {
+	      pkt[i] = in[i];
+	      ASSERT (buf_init (&pkt[i], FRAME_HEADROOM (frame)));
+	      ASSERT (buf_write (&pkt[i], BPTR (&payload), size));
+	    }
+
+	  openvpn_gettimeofday (&t[BENCH_COMPRESS], NULL);
+#ifdef USE_LZO
+	  if (comp)
+	    for (i = 0; i < n; ++i)
+	      lzo_compress (&pkt[i], compress_work[i], &c->c2.lzo_compwork, frame);
+#endif
+	  openvpn_gettimeofday (&t[BENCH_ENCRYPT], NULL);
+	  openvpn_encrypt_batch (pkt, encrypt_work, n, &c->c2.crypto_options, frame);
+	  openvpn_gettimeofday (&t[BENCH_DECRYPT], NULL);
+	  openvpn_decrypt_batch (pkt, decrypt_work, n, &c->c2.crypto_options, frame);
+	  openvpn_gettimeofday (&t[BENCH_DECOMPRESS], NULL);
+#ifdef USE_LZO
+	  if (comp)
+	    for (i = 0; i < n; ++i)
+	      lzo_decompress (&pkt[i], decompress_work[i], &c->c2.lzo_compwork, frame);
+#endif
+	  openvpn_gettimeofday (&t[BENCH_TOTAL], NULL);
+
+	  for (i = BENCH_COMPRESS; i < BENCH_TOTAL; ++i)
+	    usec[i] += tv_subtract (&t[i + 1], &t[i], 60);
+	  usec[BENCH_TOTAL] += tv_subtract (&t[BENCH_TOTAL], &t[BENCH_COMPRESS], 60);
+
+	  /* make sure the data path is still doing its job */
+	  for (i = 0; i < n; ++i)
+	    if (BLEN (&pkt[i]) != size || memcmp (BPTR (&pkt[i]), BPTR (&payload), size))
+	      msg (M_FATAL, "BENCHMARK FAILED, size=%d len=%d", size, BLEN (&pkt[i]));
+
+	  done += n;
+	}
+
+      for (i = 0; i < BENCH_N; ++i)
+	if (comp || (i != BENCH_COMPRESS && i != BENCH_DECOMPRESS))
+	  bench_print (fp, size, i, done, usec[i]);
+    }
+
+  if (fp == stderr)
+    fflush (fp);
+  else if (fclose (fp))
+    msg (M_ERR, "Write error on --benchmark-output file %s", o->benchmark_output);
+  msg (M_INFO, PACKAGE_NAME " benchmark mode SUCCEEDED.");
+  gc_free (&gc);
+}
+
 /*
  * Do a loopback test
  * on the crypto subsystem.
@@ -3518,10 +3737,25 @@ test_crypto_thread (void *arg)
   context_init_1 (c);
   do_init_crypto_static (c, 0);
 
+#ifdef USE_LZO
+  if (options->benchmark_packets && (options->lzo & LZO_SELECTED))
+    {
+      lzo_adjust_frame_parameters (&c->c2.frame);
+      lzo_compress_init (&c->c2.lzo_compwork, options->lzo, options->comp_alg, DEV_TYPE_UNDEF);
+    }
+#endif
+
   frame_finalize_options (c, options);
 
-  test_crypto (&c->c2.crypto_options, &c->c2.frame);
+  if (options->benchmark_packets)
+    benchmark_data_channel (c);
+  else
+    test_crypto (&c->c2.crypto_options, &c->c2.frame);
 
+#ifdef USE_LZO
+  if (lzo_defined (&c->c2.lzo_compwork))
+    lzo_compress_uninit (&c->c2.lzo_compwork);
+#endif
   key_schedule_free (&c->c1.ks, true);
   packet_id_free (&c->c2.packet_id);
 
@@ -27,11 +27,69 @@
 #ifdef USE_LZO
 
 #include "lzo.h"
+#include "comp-lz4.h"
 #include "error.h"
 #include "otime.h"
+#include "proto.h"
 
 #include "memdbg.h"
 
+/*
+ * LZO algorithm
+ */
+
+static bool
+lzo_alg_init (void)
+{
+  return lzo_init () == LZO_E_OK;
+}
+
+static int
+lzo_alg_compress (const uint8_t *src, int src_len,
+		  uint8_t *dst, int *dst_len, void *wmem)
+{
+  lzo_uint zlen = 0;
+  const int err = LZO_COMPRESS (src, src_len, dst, &zlen, wmem);
+  *dst_len = zlen;
+  return err;
+}
+
+static int
+lzo_alg_decompress (const uint8_t *src, int src_len,
+		    uint8_t *dst, int *dst_len)
+{
+  lzo_uint zlen = *dst_len;
+  const int err = LZO_DECOMPRESS (src, src_len, dst, &zlen, NULL);
+  *dst_len = zlen;
+  return err;
+}
+
+const struct compress_alg lzo_alg = {
+  "LZO",
+  0x66,
+  LZO_WORKSPACE,
+  lzo_alg_init,
+  lzo_alg_compress,
+  lzo_alg_decompress
+};
+
+/* NULL if algorithm was not compiled in */
+const struct compress_alg *
+compress_alg_get (int alg)
+{
+  switch (alg)
+    {
+    case COMP_ALG_LZO:
+      return &lzo_alg;
+#ifdef USE_LZ4
+    case COMP_ALG_LZ4:
+      return &lz4_alg;
+#endif
+    default:
+      return NULL;
+    }
+}
+
 static bool
 lzo_adaptive_compress_test (struct lzo_adaptive_compress *ac)
 {
@@ -79,6 +137,49 @@ lzo_adaptive_compress_data (struct lzo_adaptive_compress *ac, int n_total, int n
   ac->n_comp += n_comp;
 }
 
+/*
+ * Return the adaptive compression state for the flow buf belongs to.
+ */
+static struct lzo_adaptive_compress *
+lzo_adaptive_compress_flow (struct lzo_compress_workspace *lzowork, const struct buffer *buf)
+{
+  struct buffer ipbuf = *buf;
+  const struct openvpn_iphdr *ip;
+  struct lzo_adaptive_flow *f;
+  uint32_t ports = 0;
+  uint32_t key;
+  int hlen;
+
+  if (!is_ipv4 (lzowork->tunnel_type, &ipbuf))
+    return &lzowork->ac;
+  ip = (const struct openvpn_iphdr *) BPTR (&ipbuf);
+  if (ip->protocol != OPENVPN_IPPROTO_TCP && ip->protocol != OPENVPN_IPPROTO_UDP)
+    return &lzowork->ac;
+
+  /* ports are only in the first fragment */
+  hlen = OPENVPN_IPH_GET_LEN (ip->version_len);
+  if (!(ntohs (ip->frag_off) & OPENVPN_IP_OFFMASK) && BLEN (&ipbuf) >= hlen + 4)
+    {
+      const struct openvpn_udphdr *uh = (const struct openvpn_udphdr *) (BPTR (&ipbuf) + hlen);
+      ports = ((uint32_t) ntohs (uh->source) << 16) | ntohs (uh->dest);
+    }
+
+  key = (ntohl (ip->saddr) * 2654435761u) ^ ntohl (ip->daddr);
+  key = ((key ^ ports) * 2654435761u) ^ ip->protocol;
+  if (!key)
+    key = 1;
+
+  if (!lzowork->flows)
+    ALLOC_ARRAY_CLEAR (lzowork->flows, struct lzo_adaptive_flow, AC_FLOWS);
+  f = &lzowork->flows[key >> (32 - AC_FLOWS_BITS)];
+  if (f->key != key)
+    {
+      CLEAR (*f);
+      f->key = key;
+    }
+  return &f->ac;
+}
+
 void lzo_adjust_frame_parameters (struct frame *frame)
 {
   /* Leave room for our one-byte compressed/didn't-compress prefix byte. */
@@ -89,19 +190,65 @@ void lzo_adjust_frame_parameters (struct frame *frame)
   frame_add_to_extra_buffer (frame, LZO_EXTRA_BUFFER (EXPANDED_SIZE(frame)));
 }
 
+/*
+ * The compressor workspace is only needed while we compress
+ * outgoing packets (LZO_ON); decompression needs none.  Drop
+ * it while compression is off, e.g. after a pushed
+ * "comp-lzo no", and get it back when it is turned on.
+ * Likewise drop the flow table when adaptive mode goes away.
+ */
+static void
+lzo_workspace_adjust (struct lzo_compress_workspace *lzowork)
+{
+  if ((lzowork->flags & LZO_ON) && !lzowork->wmem)
+    {
+      lzowork->wmem = (lzo_voidp) lzo_malloc (lzowork->wmem_size);
+      check_malloc_return (lzowork->wmem);
+    }
+  else if (!(lzowork->flags & LZO_ON) && lzowork->wmem)
+    {
+      lzo_free (lzowork->wmem);
+      lzowork->wmem = NULL;
+    }
+
+  if (!(lzowork->flags & LZO_ADAPTIVE) && lzowork->flows)
+    {
+      free (lzowork->flows);
+      lzowork->flows = NULL;
+    }
+}
+
 void
-lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags)
+lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags, int alg,
+		   int tunnel_type)
 {
+  int i;
+
   CLEAR (*lzowork);
 
-  lzowork->wmem_size = LZO_WORKSPACE;
+  lzowork->alg = compress_alg_get (alg);
+  ASSERT (lzowork->alg);
   lzowork->flags = flags;
+  lzowork->tunnel_type = tunnel_type;
 
-  if (lzo_init () != LZO_E_OK)
-    msg (M_FATAL, "Cannot initialize LZO compression library");
-  lzowork->wmem = (lzo_voidp) lzo_malloc (lzowork->wmem_size);
-  check_malloc_return (lzowork->wmem);
-  msg (M_INFO, "LZO compression initialized");
+  /*
+   * Initialize every compiled-in algorithm, since we decompress
+   * whatever the peer sends, and size the workspace for the largest
+   * so that a pushed option can switch algorithms.
+   */
+  for (i = 0; i < COMP_ALG_N; ++i)
+    {
+      const struct compress_alg *ca = compress_alg_get (i);
+      if (ca)
+	{
+	  if (ca->init && !(*ca->init) ())
+	    msg (M_FATAL, "Cannot initialize %s compression library", ca->name);
+	  lzowork->wmem_size = max_int (lzowork->wmem_size, ca->wmem_size);
+	}
+    }
+
+  lzo_workspace_adjust (lzowork);
+  msg (M_INFO, "%s compression initialized", lzowork->alg->name);
   lzowork->defined = true;
 }
 
@@ -111,27 +258,72 @@ lzo_compress_uninit (struct lzo_compress_workspace *lzowork)
   if (lzowork)
     {
       ASSERT (lzowork->defined);
-      lzo_free (lzowork->wmem);
+      if (lzowork->wmem)
+	lzo_free (lzowork->wmem);
       lzowork->wmem = NULL;
+      free (lzowork->flows);
+      lzowork->flows = NULL;
       lzowork->defined = false;
     }
 }
 
+/*
+ * Return true if buf looks like random data, by counting
+ * distinct byte values in a sample from its end.
+ */
+static bool
+lzo_incompressible (const struct buffer *buf)
+{
+  const int n = min_int (BLEN (buf), ENTROPY_SAMPLE);
+  const int max_distinct = n * ENTROPY_DISTINCT_PCT / 100;
+  const uint8_t *p = BPTR (buf) + BLEN (buf) - n;
+  uint32_t seen[256 / 32];
+  int i, distinct = 0;
+
+  CLEAR (seen);
+  for (i = 0; i < n; ++i)
+    {
+      const uint8_t c = p[i];
+      const uint32_t bit = 1u << (c & 31);
+      if (!(seen[c >> 5] & bit))
+	{
+	  seen[c >> 5] |= bit;
+	  if (++distinct > max_distinct)
+	    return true;
+	}
+    }
+  return false;
+}
+
 static inline bool
-lzo_compression_enabled (struct lzo_compress_workspace *lzowork)
+lzo_skip_incompressible (struct lzo_compress_workspace *lzowork, const struct buffer *buf)
+{
+  if ((lzowork->flags & LZO_ADAPTIVE) && lzo_incompressible (buf))
+    {
+      ++lzowork->incompressible;
+      return true;
+    }
+  return false;
+}
+
+/* ac is the flow's adaptive compression state, NULL if not adaptive */
+static inline bool
+lzo_compression_enabled (struct lzo_compress_workspace *lzowork, struct lzo_adaptive_compress *ac)
 {
   if ((lzowork->flags & (LZO_SELECTED|LZO_ON)) == (LZO_SELECTED|LZO_ON))
     {
-      if (lzowork->flags & LZO_ADAPTIVE)
-	return lzo_adaptive_compress_test (&lzowork->ac);
+      if (ac)
+	return lzo_adaptive_compress_test (ac);
       else
 	return true;
     }
   return false;
 }
 
-/* Magic numbers to tell our peer if we compressed or not */
-#define YES_COMPRESS 0x66
+/*
+ * Magic number to tell our peer we didn't compress; a compressed
+ * packet is prefixed with compress_alg.compress_byte.
+ */
 #define NO_COMPRESS  0xFA
 
 void
@@ -139,7 +331,8 @@ lzo_compress (struct buffer *buf, struct buffer work,
 	      struct lzo_compress_workspace *lzowork,
 	      const struct frame* frame)
 {
-  lzo_uint zlen = 0;
+  struct lzo_adaptive_compress *ac = NULL;
+  int zlen;
   int err;
   bool compressed = false;
 
@@ -148,12 +341,18 @@ lzo_compress (struct buffer *buf, struct buffer work,
   if (buf->len <= 0)
     return;
 
+  if ((lzowork->flags & LZO_ADAPTIVE) && buf->len >= COMPRESS_THRESHOLD)
+    ac = lzo_adaptive_compress_flow (lzowork, buf);
+
   /*
    * In order to attempt compression, length must be at least COMPRESS_THRESHOLD,
-   * and our adaptive level must give the OK.
+   * our adaptive level must give the OK, and in adaptive mode the
+   * packet must not look like random data.
    */
-  if (buf->len >= COMPRESS_THRESHOLD && lzo_compression_enabled (lzowork))
+  if (buf->len >= COMPRESS_THRESHOLD && lzo_compression_enabled (lzowork, ac)
+      && !lzo_skip_incompressible (lzowork, buf))
     {
+
       ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
       ASSERT (buf_safe (&work, LZO_EXTRA_BUFFER (PAYLOAD_SIZE (frame))));
 
@@ -164,10 +363,11 @@ lzo_compress (struct buffer *buf, struct buffer work,
 	  return;
 	}
 
-      err = LZO_COMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzowork->wmem);
-      if (err != LZO_E_OK)
+      zlen = buf_forward_capacity (&work);
+      err = (*lzowork->alg->compress) (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzowork->wmem);
+      if (err)
 	{
-	  dmsg (D_COMP_ERRORS, "LZO compression error: %d", err);
+	  dmsg (D_COMP_ERRORS, "%s compression error: %d", lzowork->alg->name, err);
 	  buf->len = 0;
 	  return;
 	}
@@ -181,15 +381,15 @@ lzo_compress (struct buffer *buf, struct buffer work,
       lzowork->post_compress += work.len;
 
       /* tell adaptive level about our success or lack thereof in getting any size reduction */
-      if (lzowork->flags & LZO_ADAPTIVE)
-	lzo_adaptive_compress_data (&lzowork->ac, buf->len, work.len);
+      if (ac)
+	lzo_adaptive_compress_data (ac, buf->len, work.len);
     }
 
   /* did compression save us anything ? */
   if (compressed && work.len < buf->len)
     {
       uint8_t *header = buf_prepend (&work, 1);
-      *header = YES_COMPRESS;
+      *header = lzowork->alg->compress_byte;
       *buf = work;
     }
   else
@@ -204,9 +404,10 @@ lzo_decompress (struct buffer *buf, struct buffer work,
 		struct lzo_compress_workspace *lzowork,
 		const struct frame* frame)
 {
-  lzo_uint zlen = EXPANDED_SIZE (frame);
+  int zlen = EXPANDED_SIZE (frame);
   uint8_t c;		/* flag indicating whether or not our peer compressed */
-  int err;
+  const struct compress_alg *ca = NULL;
+  int i, err;
 
   ASSERT (lzowork->defined);
 
@@ -218,14 +419,24 @@ lzo_decompress (struct buffer *buf, struct buffer work,
   c = *BPTR (buf);
   ASSERT (buf_advance (buf, 1));
 
-  if (c == YES_COMPRESS)	/* packet was compressed */
+  /* which algorithm, if any, did our peer use? */
+  for (i = 0; i < COMP_ALG_N; ++i)
+    {
+      const struct compress_alg *a = compress_alg_get (i);
+      if (a && c == a->compress_byte)
+	{
+	  ca = a;
+	  break;
+	}
+    }
+
+  if (ca)	/* packet was compressed */
     {
       ASSERT (buf_safe (&work, zlen));
-      err = LZO_DECOMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen,
-			    lzowork->wmem);
-      if (err != LZO_E_OK)
+      err = (*ca->decompress) (BPTR (buf), BLEN (buf), BPTR (&work), &zlen);
+      if (err)
 	{
-	  dmsg (D_COMP_ERRORS, "LZO decompression error: %d", err);
+	  dmsg (D_COMP_ERRORS, "%s decompression error: %d", ca->name, err);
 	  buf->len = 0;
 	  return;
 	}
@@ -251,10 +462,27 @@ lzo_decompress (struct buffer *buf, struct buffer work,
 }
 
 void
-lzo_modify_flags (struct lzo_compress_workspace *lzowork, unsigned int flags)
+lzo_modify_flags (struct lzo_compress_workspace *lzowork, unsigned int flags, int alg)
 {
   ASSERT (lzowork->defined);
+  lzowork->alg = compress_alg_get (alg);
+  ASSERT (lzowork->alg);
   lzowork->flags = flags;
+  lzo_workspace_adjust (lzowork);
+}
+
+size_t
+lzo_memory (const struct lzo_compress_workspace *lzowork)
+{
+  size_t ret = 0;
+  if (lzowork->defined)
+    {
+      if (lzowork->wmem)
+	ret += lzowork->wmem_size;
+      if (lzowork->flows)
+	ret += AC_FLOWS * sizeof (struct lzo_adaptive_flow);
+    }
+  return ret;
 }
 
 /*
@@ -268,6 +496,7 @@ void lzo_print_stats (const struct lzo_compress_workspace *lzo_compwork, struct
   status_printf (so, "post-compress bytes," counter_format, lzo_compwork->post_compress);
   status_printf (so, "pre-decompress bytes," counter_format, lzo_compwork->pre_decompress);
   status_printf (so, "post-decompress bytes," counter_format, lzo_compwork->post_decompress);
+  status_printf (so, "incompressible packets," counter_format, lzo_compwork->incompressible);
 }
 
 #else
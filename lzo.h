@@ -45,6 +45,42 @@
 #define LZO_ON         (1<<1)
 #define LZO_ADAPTIVE   (1<<2)  
 
+/*
+ * Compression algorithms.  The workspace, framing and adaptive
+ * logic below are shared; each algorithm is a struct compress_alg.
+ */
+#define COMP_ALG_LZO   0
+#define COMP_ALG_LZ4   1
+#define COMP_ALG_N     2
+
+struct compress_alg
+{
+  const char *name;
+
+  /* prefix byte which marks a packet compressed with this algorithm */
+  uint8_t compress_byte;
+
+  /* size of compression workspace */
+  int wmem_size;
+
+  /* one-time library initialization, may be NULL */
+  bool (*init) (void);
+
+  /*
+   * On entry *dst_len is the space available at dst, on
+   * successful return it is the output length.  Return 0 on
+   * success or an algorithm-specific nonzero error code.
+   */
+  int (*compress) (const uint8_t *src, int src_len,
+		   uint8_t *dst, int *dst_len, void *wmem);
+  int (*decompress) (const uint8_t *src, int src_len,
+		     uint8_t *dst, int *dst_len);
+};
+
+extern const struct compress_alg lzo_alg;
+
+const struct compress_alg *compress_alg_get (int alg);
+
 /*
  * Use LZO compress routine lzo1x_1_15_compress which is described
  * as faster but needs a bit more memory than the standard routine.
@@ -58,7 +94,8 @@
 #define LZO_WORKSPACE	LZO1X_1_15_MEM_COMPRESS
 #define LZO_DECOMPRESS  lzo1x_decompress_safe
 
-#define LZO_EXTRA_BUFFER(len) ((len)/8 + 128 + 3)	/* LZO 2.0 worst case size expansion. */
+#define LZO_EXTRA_BUFFER(len) ((len)/8 + 128 + 3)	/* LZO 2.0 worst case size expansion,
+							   also covers LZ4 */
 
 /*
  * Don't try to compress any packet smaller than this.
@@ -81,6 +118,17 @@
 #define AC_OFF_SEC     60     /* if we turn off compression, don't do sample
 				 retest for n seconds */
 
+/*
+ * Per-packet entropy pre-check (adaptive mode only).  Sample the
+ * last ENTROPY_SAMPLE bytes of the packet, past the IP/TCP headers,
+ * and don't try to compress it if more than ENTROPY_DISTINCT_PCT % of
+ * the sampled bytes are distinct values.  Random or already
+ * encrypted/compressed data gives about 80 %, text and most
+ * protocol data far less.
+ */
+#define ENTROPY_SAMPLE         128
+#define ENTROPY_DISTINCT_PCT   65
+
 struct lzo_adaptive_compress {
   bool compress_state;
   time_t next;
@@ -88,15 +136,35 @@ struct lzo_adaptive_compress {
   int n_comp;
 };
 
+/*
+ * Adaptive compression state is kept per flow, so that one
+ * incompressible transfer doesn't turn compression off for the
+ * rest of the tunnel.  IPv4 TCP/UDP flows are hashed by
+ * (protocol, addresses, ports) into a direct-mapped table of
+ * AC_FLOWS entries; a new flow landing in a slot evicts the old
+ * one.  Other packets share the per-tunnel state.  The table is
+ * only allocated once adaptive compression sees its first packet.
+ */
+#define AC_FLOWS_BITS  6
+#define AC_FLOWS       (1<<AC_FLOWS_BITS)
+
+struct lzo_adaptive_flow {
+  uint32_t key;			/* flow hash, 0 if slot unused */
+  struct lzo_adaptive_compress ac;
+};
+
 /*
  * Compress and Uncompress routines.
  */
 
 struct lzo_compress_workspace
 {
+  const struct compress_alg *alg;
   lzo_voidp wmem;
   int wmem_size;
   struct lzo_adaptive_compress ac;
+  struct lzo_adaptive_flow *flows;	/* AC_FLOWS entries, NULL until needed */
+  int tunnel_type;		/* DEV_TYPE_x, to find the IP header */
   unsigned int flags;
   bool defined;
 
@@ -105,15 +173,20 @@ struct lzo_compress_workspace
   counter_type post_decompress;
   counter_type pre_compress;
   counter_type post_compress;
+  counter_type incompressible;	/* packets skipped by entropy pre-check */
 };
 
 void lzo_adjust_frame_parameters(struct frame *frame);
 
-void lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags);
+void lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags, int alg,
+			int tunnel_type);
 
 void lzo_compress_uninit (struct lzo_compress_workspace *lzowork);
 
-void lzo_modify_flags (struct lzo_compress_workspace *lzowork, unsigned int flags);
+void lzo_modify_flags (struct lzo_compress_workspace *lzowork, unsigned int flags, int alg);
+
+/* heap bytes held by the compression workspace */
+size_t lzo_memory (const struct lzo_compress_workspace *lzowork);
 
 void lzo_compress (struct buffer *buf, struct buffer work,
 		   struct lzo_compress_workspace *lzowork,
@@ -37,6 +37,7 @@
 #include "ssl.h"
 #include "common.h"
 #include "manage.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -79,6 +80,7 @@ man_help ()
   msg (M_CLIENT, "load-stats             : Show global server load stats.");
   msg (M_CLIENT, "log [on|off] [N|all]   : Turn on/off realtime log display");
   msg (M_CLIENT, "                         + show last N lines or 'all' for entire history.");
+  msg (M_CLIENT, "metrics                : Show counters and gauges in Prometheus text format.");
   msg (M_CLIENT, "mute [n]               : Set log mute level to n, or show level if n is absent.");
   msg (M_CLIENT, "needok type action     : Enter confirmation for NEED-OK request of 'type',");
   msg (M_CLIENT, "                         where action = 'ok' or 'cancel'.");
@@ -87,6 +89,10 @@ man_help ()
   msg (M_CLIENT, "net                    : (Windows only) Show network info and routing table.");
   msg (M_CLIENT, "password type p        : Enter password p for a queried OpenVPN password.");
   msg (M_CLIENT, "pid                    : Show process ID of the current OpenVPN process.");
+#ifdef ENABLE_PERFORMANCE_METRICS
+  msg (M_CLIENT, "perf [on|off|reset]    : Show per-stage latency percentiles (usec),");
+  msg (M_CLIENT, "                         or turn measurement on/off, or clear it.");
+#endif
 #ifdef ENABLE_PKCS11
   msg (M_CLIENT, "pkcs11-id-count        : Get number of available PKCS#11 identities.");
   msg (M_CLIENT, "pkcs11-id-get index    : Get PKCS#11 identity at index.");
@@ -739,6 +745,42 @@ man_pkcs11_id_get (struct management *man, const int index)
 
 #endif
 
+#ifdef ENABLE_PERFORMANCE_METRICS
+
+static void
+man_perf (const char *cmd)
+{
+  if (cmd)
+    {
+      if (streq (cmd, "on"))
+	{
+	  perf_enable (true);
+	  msg (M_CLIENT, "SUCCESS: perf measurement set to ON");
+	}
+      else if (streq (cmd, "off"))
+	{
+	  perf_enable (false);
+	  msg (M_CLIENT, "SUCCESS: perf measurement set to OFF");
+	}
+      else if (streq (cmd, "reset"))
+	{
+	  perf_reset ();
+	  msg (M_CLIENT, "SUCCESS: perf histograms cleared");
+	}
+      else
+	{
+	  msg (M_CLIENT, "ERROR: bad perf command parameter");
+	}
+    }
+  else
+    {
+      perf_print (M_CLIENT);
+      msg (M_CLIENT, "END");
+    }
+}
+
+#endif
+
 static void
 man_hold (struct management *man, const char *cmd)
 {
@@ -993,13 +1035,40 @@ man_load_stats (struct management *man)
   extern counter_type link_read_bytes_global;
   extern counter_type link_write_bytes_global;
   int nclients = 0;
+  unsigned long clientmem = 0;
 
   if (man->persist.callback.n_clients)
     nclients = (*man->persist.callback.n_clients) (man->persist.callback.arg);
-  msg (M_CLIENT, "SUCCESS: nclients=%d,bytesin=" counter_format ",bytesout=" counter_format,
+  if (man->persist.callback.client_memory)
+    clientmem = (unsigned long) (*man->persist.callback.client_memory) (man->persist.callback.arg);
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  {
+    int reneg_pending, reneg_active;
+    tls_reneg_status (&reneg_pending, &reneg_active);
+    msg (M_CLIENT, "SUCCESS: nclients=%d,bytesin=" counter_format ",bytesout=" counter_format ",reneg_pending=%d,reneg_active=%d,clientmem=%lu",
+	 nclients,
+	 link_read_bytes_global,
+	 link_write_bytes_global,
+	 reneg_pending,
+	 reneg_active,
+	 clientmem);
+  }
+#else
+  msg (M_CLIENT, "SUCCESS: nclients=%d,bytesin=" counter_format ",bytesout=" counter_format ",clientmem=%lu",
        nclients,
        link_read_bytes_global,
-       link_write_bytes_global);
+       link_write_bytes_global,
+       clientmem);
+#endif
+}
+
+static void
+man_metrics (struct management *man)
+{
+  metrics_print (M_CLIENT);
+  if (man->persist.callback.metrics)
+    (*man->persist.callback.metrics) (man->persist.callback.arg, M_CLIENT);
+  msg (M_CLIENT, "END");
 }
 
 #define MN_AT_LEAST (1<<0)
@@ -1096,6 +1165,10 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
     {
       man_load_stats (man);
     }
+  else if (streq (p[0], "metrics"))
+    {
+      man_metrics (man);
+    }
   else if (streq (p[0], "status"))
     {
       int version = 0;
@@ -1216,6 +1289,12 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
     {
       man_hold (man, p[1]);
     }
+#ifdef ENABLE_PERFORMANCE_METRICS
+  else if (streq (p[0], "perf"))
+    {
+      man_perf (p[1]);
+    }
+#endif
   else if (streq (p[0], "bytecount"))
     {
       if (man_need (man, p, 1, 0))
@@ -1679,7 +1758,7 @@ man_process_command (struct management *man, const char *line)
       nparms = parse_line (line, parms, MAX_PARMS, "TCP", 0, M_CLIENT, &gc);
       if (parms[0] && streq (parms[0], "password"))
 	msg (D_MANAGEMENT_DEBUG, "MANAGEMENT: CMD 'password [...]'");
-      else if (!streq (line, "load-stats"))
+      else if (!streq (line, "load-stats") && !streq (line, "metrics"))
 	msg (D_MANAGEMENT_DEBUG, "MANAGEMENT: CMD '%s'", line);
 
 #if 0
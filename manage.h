@@ -155,6 +155,8 @@ struct management_callback
   int (*kill_by_addr) (void *arg, const in_addr_t addr, const int port);
   void (*delete_event) (void *arg, event_t event);
   int (*n_clients) (void *arg);
+  size_t (*client_memory) (void *arg);
+  void (*metrics) (void *arg, const int msglevel);
 #ifdef MANAGEMENT_DEF_AUTH
   bool (*kill_by_cid) (void *arg, const unsigned long cid);
   bool (*client_auth) (void *arg,
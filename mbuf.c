@@ -30,6 +30,7 @@
 #include "error.h"
 #include "misc.h"
 #include "mbuf.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -54,19 +55,79 @@ mbuf_free (struct mbuf_set *ms)
 	  struct mbuf_item *item = &ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
 	  mbuf_free_buf (item->buffer);
 	}
+      metrics.mbuf_queued -= ms->len;
       free (ms->array);
       free (ms);
     }
 }
 
+/*
+ * Pool of frame-sized mbuf_buffers.  Released buffers are
+ * pushed on the front of the list and reused first, so the
+ * ones that get handed out are likely still in cache.
+ * Only touched from the event loop thread.
+ */
+struct mbuf_pool
+{
+  int buf_size;
+  int max;
+  int len;
+  struct mbuf_buffer *free_list;
+};
+
+static struct mbuf_pool mbuf_pool; /* GLOBAL */
+
+void
+mbuf_pool_init (int buf_size, int max)
+{
+  mbuf_pool_free ();
+  mbuf_pool.buf_size = buf_size;
+  mbuf_pool.max = max;
+}
+
+void
+mbuf_pool_free (void)
+{
+  while (mbuf_pool.free_list)
+    {
+      struct mbuf_buffer *mb = mbuf_pool.free_list;
+      mbuf_pool.free_list = mb->next_free;
+      free_buf (&mb->buf);
+      free (mb);
+    }
+  CLEAR (mbuf_pool);
+}
+
 struct mbuf_buffer *
 mbuf_alloc_buf (const struct buffer *buf)
 {
   struct mbuf_buffer *ret;
-  ALLOC_OBJ (ret, struct mbuf_buffer);
-  ret->buf = clone_buf (buf);
+
+  if (mbuf_pool.buf_size && buf->offset + buf->len <= mbuf_pool.buf_size)
+    {
+      if (mbuf_pool.free_list)
+	{
+	  ret = mbuf_pool.free_list;
+	  mbuf_pool.free_list = ret->next_free;
+	  --mbuf_pool.len;
+	}
+      else
+	{
+	  ALLOC_OBJ (ret, struct mbuf_buffer);
+	  ret->buf = alloc_buf (mbuf_pool.buf_size);
+	}
+      ret->buf.offset = buf->offset;
+      ret->buf.len = buf->len;
+      memcpy (BPTR (&ret->buf), BPTR (buf), BLEN (buf));
+    }
+  else
+    {
+      ALLOC_OBJ (ret, struct mbuf_buffer);
+      ret->buf = clone_buf (buf);
+    }
   ret->refcount = 1;
   ret->flags = 0;
+  ret->next_free = NULL;
   return ret;
 }
 
@@ -77,8 +138,17 @@ mbuf_free_buf (struct mbuf_buffer *mb)
     {
       if (--mb->refcount <= 0)
 	{
-	  free_buf (&mb->buf);
-	  free (mb);
+	  if (mb->buf.capacity == mbuf_pool.buf_size && mbuf_pool.len < mbuf_pool.max)
+	    {
+	      mb->next_free = mbuf_pool.free_list;
+	      mbuf_pool.free_list = mb;
+	      ++mbuf_pool.len;
+	    }
+	  else
+	    {
+	      free_buf (&mb->buf);
+	      free (mb);
+	    }
 	}
     }
 }
@@ -92,6 +162,7 @@ mbuf_add_item (struct mbuf_set *ms, const struct mbuf_item *item)
       struct mbuf_item rm;
       ASSERT (mbuf_extract_item (ms, &rm));
       mbuf_free_buf (rm.buffer);
+      metric_drop (METRIC_DROP_QUEUE_FULL);
       msg (D_MULTI_DROPPED, "MBUF: mbuf packet dropped");
     }
 
@@ -100,6 +171,7 @@ mbuf_add_item (struct mbuf_set *ms, const struct mbuf_item *item)
   ms->array[MBUF_INDEX(ms->head, ms->len, ms->capacity)] = *item;
   if (++ms->len > ms->max_queued)
     ms->max_queued = ms->len;
+  ++metrics.mbuf_queued;
   ++item->buffer->refcount;
 }
 
@@ -114,6 +186,7 @@ mbuf_extract_item (struct mbuf_set *ms, struct mbuf_item *item)
 	  *item = ms->array[ms->head];
 	  ms->head = MBUF_INDEX(ms->head, 1, ms->capacity);
 	  --ms->len;
+	  --metrics.mbuf_queued;
 	  if (item->instance) /* ignore dereferenced instances */
 	    {
 	      ret = true;
@@ -164,6 +237,24 @@ mbuf_dereference_instance (struct mbuf_set *ms, struct multi_instance *mi)
     }
 }
 
+size_t
+mbuf_memory (const struct mbuf_set *ms)
+{
+  size_t ret = 0;
+  if (ms)
+    {
+      unsigned int i;
+      ret += sizeof (*ms) + ms->capacity * sizeof (struct mbuf_item);
+      for (i = 0; i < ms->len; ++i)
+	{
+	  const struct mbuf_item *item = &ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
+	  if (item->buffer)
+	    ret += sizeof (struct mbuf_buffer) + item->buffer->buf.capacity;
+	}
+    }
+  return ret;
+}
+
 #else
 static void dummy(void) {}
 #endif /* P2MP */
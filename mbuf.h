@@ -48,6 +48,8 @@ struct mbuf_buffer
 
 # define MF_UNICAST (1<<0)
   unsigned int flags;
+
+  struct mbuf_buffer *next_free;  /* link while on the buffer pool free list */
 };
 
 struct mbuf_item
@@ -71,12 +73,23 @@ void mbuf_free (struct mbuf_set *ms);
 struct mbuf_buffer *mbuf_alloc_buf (const struct buffer *buf);
 void mbuf_free_buf (struct mbuf_buffer *mb);
 
+/*
+ * Keep up to max released mbuf_buffers of buf_size bytes
+ * (normally BUF_SIZE of the tunnel frame) on a free list,
+ * so that mbuf_alloc_buf doesn't hit malloc per packet.
+ */
+void mbuf_pool_init (int buf_size, int max);
+void mbuf_pool_free (void);
+
 void mbuf_add_item (struct mbuf_set *ms, const struct mbuf_item *item);
 
 bool mbuf_extract_item (struct mbuf_set *ms, struct mbuf_item *item);
 
 void mbuf_dereference_instance (struct mbuf_set *ms, struct multi_instance *mi);
 
+/* heap bytes held by ms, including queued buffers */
+size_t mbuf_memory (const struct mbuf_set *ms);
+
 static inline bool
 mbuf_defined (const struct mbuf_set *ms)
 {
@@ -89,6 +102,22 @@ mbuf_len (const struct mbuf_set *ms)
   return ms->len;
 }
 
+static inline bool
+mbuf_full (const struct mbuf_set *ms)
+{
+  return ms->len == ms->capacity;
+}
+
+/* i'th queued item from the head, or NULL */
+static inline struct mbuf_item *
+mbuf_item_at (struct mbuf_set *ms, const unsigned int i)
+{
+  if (ms && i < ms->len)
+    return &ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
+  else
+    return NULL;
+}
+
 static inline int
 mbuf_maximum_queued (const struct mbuf_set *ms)
 {
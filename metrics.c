@@ -0,0 +1,111 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#include "error.h"
+#include "metrics.h"
+
+#include "memdbg.h"
+
+struct metrics metrics; /* GLOBAL */
+
+static const char *drop_names[] = {
+  "decrypt",
+  "replay",
+  "queue_full",
+  "saturation",
+  "bad_source"
+};
+
+static const char *reject_names[] = {
+  "connect_freq",
+  "max_clients"
+};
+
+static const int handshake_buckets[] = METRIC_HANDSHAKE_BUCKETS;
+
+void
+metric_tls_handshake (const int msec)
+{
+  int i;
+  ++metrics.tls_handshakes;
+  metrics.tls_handshake_msec += msec;
+  for (i = 0; i < METRIC_HANDSHAKE_N; ++i)
+    if (msec <= handshake_buckets[i])
+      ++metrics.tls_handshake_bucket[i];
+}
+
+void
+metrics_print (const int msglevel)
+{
+  extern counter_type link_read_bytes_global;
+  extern counter_type link_write_bytes_global;
+  int i;
+
+  ASSERT (SIZE (drop_names) == METRIC_DROP_N);
+  ASSERT (SIZE (reject_names) == METRIC_REJECT_N);
+  ASSERT (SIZE (handshake_buckets) == METRIC_HANDSHAKE_N);
+
+  msg (msglevel, "# TYPE openvpn_link_bytes_total counter");
+  msg (msglevel, "openvpn_link_bytes_total{direction=\"in\"} " counter_format, link_read_bytes_global);
+  msg (msglevel, "openvpn_link_bytes_total{direction=\"out\"} " counter_format, link_write_bytes_global);
+  msg (msglevel, "# TYPE openvpn_link_packets_total counter");
+  msg (msglevel, "openvpn_link_packets_total{direction=\"in\"} " counter_format, metrics.link_read_packets);
+  msg (msglevel, "openvpn_link_packets_total{direction=\"out\"} " counter_format, metrics.link_write_packets);
+  msg (msglevel, "# TYPE openvpn_tun_bytes_total counter");
+  msg (msglevel, "openvpn_tun_bytes_total{direction=\"in\"} " counter_format, metrics.tun_read_bytes);
+  msg (msglevel, "openvpn_tun_bytes_total{direction=\"out\"} " counter_format, metrics.tun_write_bytes);
+  msg (msglevel, "# TYPE openvpn_tun_packets_total counter");
+  msg (msglevel, "openvpn_tun_packets_total{direction=\"in\"} " counter_format, metrics.tun_read_packets);
+  msg (msglevel, "openvpn_tun_packets_total{direction=\"out\"} " counter_format, metrics.tun_write_packets);
+
+  msg (msglevel, "# TYPE openvpn_dropped_packets_total counter");
+  for (i = 0; i < METRIC_DROP_N; ++i)
+    msg (msglevel, "openvpn_dropped_packets_total{reason=\"%s\"} " counter_format, drop_names[i], metrics.drop[i]);
+  msg (msglevel, "# TYPE openvpn_rejected_connections_total counter");
+  for (i = 0; i < METRIC_REJECT_N; ++i)
+    msg (msglevel, "openvpn_rejected_connections_total{reason=\"%s\"} " counter_format, reject_names[i], metrics.reject[i]);
+
+  msg (msglevel, "# TYPE openvpn_tls_errors_total counter");
+  msg (msglevel, "openvpn_tls_errors_total " counter_format, metrics.tls_errors);
+  msg (msglevel, "# TYPE openvpn_tls_handshake_seconds histogram");
+  for (i = 0; i < METRIC_HANDSHAKE_N; ++i)
+    msg (msglevel, "openvpn_tls_handshake_seconds_bucket{le=\"%.3f\"} " counter_format,
+	 handshake_buckets[i] / 1000.0, metrics.tls_handshake_bucket[i]);
+  msg (msglevel, "openvpn_tls_handshake_seconds_bucket{le=\"+Inf\"} " counter_format, metrics.tls_handshakes);
+  msg (msglevel, "openvpn_tls_handshake_seconds_sum %.3f", metrics.tls_handshake_msec / 1000.0);
+  msg (msglevel, "openvpn_tls_handshake_seconds_count " counter_format, metrics.tls_handshakes);
+
+  msg (msglevel, "# TYPE openvpn_route_cache_lookups_total counter");
+  msg (msglevel, "openvpn_route_cache_lookups_total{result=\"hit\"} " counter_format, metrics.route_cache_hits);
+  msg (msglevel, "openvpn_route_cache_lookups_total{result=\"miss\"} " counter_format, metrics.route_cache_misses);
+
+  msg (msglevel, "# TYPE openvpn_clients_connected_total counter");
+  msg (msglevel, "openvpn_clients_connected_total " counter_format, metrics.clients_established);
+  msg (msglevel, "# TYPE openvpn_clients_disconnected_total counter");
+  msg (msglevel, "openvpn_clients_disconnected_total " counter_format, metrics.clients_closed);
+  msg (msglevel, "# TYPE openvpn_queued_packets gauge");
+  msg (msglevel, "openvpn_queued_packets %d", metrics.mbuf_queued);
+}
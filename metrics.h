@@ -0,0 +1,95 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Process-wide counters for the management interface
+ * "metrics" command.  They are bumped inline on the paths
+ * they describe, so that producing the report never has
+ * to walk the client list.
+ */
+
+#include "basic.h"
+#include "common.h"
+
+/* reasons a packet was dropped */
+#define METRIC_DROP_DECRYPT       0  /* failed HMAC, tag or decryption */
+#define METRIC_DROP_REPLAY        1  /* packet ID replayed or out of window */
+#define METRIC_DROP_QUEUE_FULL    2  /* bcast/mcast or TCP output queue overflow */
+#define METRIC_DROP_SATURATION    3  /* client output saturated */
+#define METRIC_DROP_BAD_SOURCE    4  /* client used a source address not routed to it */
+#define METRIC_DROP_N             5
+
+/* reasons a new client connection was refused */
+#define METRIC_REJECT_CONNECT_FREQ  0  /* --connect-freq */
+#define METRIC_REJECT_MAX_CLIENTS   1  /* --max-clients */
+#define METRIC_REJECT_N             2
+
+/* upper bounds of the TLS handshake duration histogram, in milliseconds */
+#define METRIC_HANDSHAKE_BUCKETS { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000 }
+#define METRIC_HANDSHAKE_N       9
+
+struct metrics
+{
+  counter_type link_read_packets;
+  counter_type link_write_packets;
+  counter_type tun_read_packets;
+  counter_type tun_read_bytes;
+  counter_type tun_write_packets;
+  counter_type tun_write_bytes;
+
+  counter_type drop[METRIC_DROP_N];
+  counter_type reject[METRIC_REJECT_N];
+
+  counter_type tls_handshakes;
+  counter_type tls_errors;
+  counter_type tls_handshake_msec;
+  counter_type tls_handshake_bucket[METRIC_HANDSHAKE_N];
+
+  counter_type route_cache_hits;
+  counter_type route_cache_misses;
+
+  counter_type clients_established;	/* reached multi_connection_established */
+  counter_type clients_closed;		/* of those, closed again */
+
+  /* gauge: packets sitting in mbuf queues, bcast and TCP output alike */
+  int mbuf_queued;
+};
+
+extern struct metrics metrics;
+
+static inline void
+metric_drop (const int reason)
+{
+  ++metrics.drop[reason];
+}
+
+void metric_tls_handshake (const int msec);
+
+/* print the process-wide counters in Prometheus text format */
+void metrics_print (const int msglevel);
+
+#endif
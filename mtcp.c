@@ -28,6 +28,7 @@
 
 #include "multi.h"
 #include "forward-inline.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -256,6 +257,39 @@ multi_tcp_context (struct multi_context *m, struct multi_instance *mi)
 static bool
 multi_tcp_process_outgoing_link_ready (struct multi_context *m, struct multi_instance *mi, const unsigned int mpp_flags)
 {
+#if TCP_WRITEV_CAPABILITY
+  struct buffer *bufs[TCP_WRITEV_MAX];
+  struct mbuf_item *item;
+  int n = 0;
+  bool ret = true;
+  ASSERT (mi);
+
+  /* write as much of the queue as the socket will take in one call */
+  while (n < TCP_WRITEV_MAX && (item = mbuf_item_at (mi->tcp_link_out_deferred, n)))
+    {
+      ASSERT (mi == item->instance);
+      bufs[n++] = &item->buffer->buf;
+    }
+
+  if (n)
+    {
+      struct mbuf_item sent;
+      int done;
+
+      dmsg (D_MULTI_TCP, "MULTI TCP: transmitting %d previously deferred packets", n);
+
+      set_prefix (mi);
+      done = process_outgoing_link_tcp_batch (&mi->context, bufs, n, &mi->tcp_link_out_partial);
+      while (done-- > 0)
+	{
+	  ASSERT (mbuf_extract_item (mi->tcp_link_out_deferred, &sent));
+	  mbuf_free_buf (sent.buffer);
+	}
+      ret = multi_process_post (m, mi, mpp_flags);
+      clear_prefix ();
+    }
+  return ret;
+#else
   struct mbuf_item item;
   bool ret = true;
   ASSERT (mi);
@@ -273,6 +307,7 @@ multi_tcp_process_outgoing_link_ready (struct multi_context *m, struct multi_ins
       mbuf_free_buf (item.buffer);
     }
   return ret;
+#endif
 }
 
 static bool
@@ -296,7 +331,16 @@ multi_tcp_process_outgoing_link (struct multi_context *m, bool defer, const unsi
 	      dmsg (D_MULTI_TCP, "MULTI TCP: queuing deferred packet");
 	      item.buffer = mb;
 	      item.instance = mi;
-	      mbuf_add_item (mi->tcp_link_out_deferred, &item);
+#if TCP_WRITEV_CAPABILITY
+	      /* the queue head must not be dropped once part of it is on the wire */
+	      if (mi->tcp_link_out_partial && mbuf_full (mi->tcp_link_out_deferred))
+		{
+		  metric_drop (METRIC_DROP_QUEUE_FULL);
+		  msg (D_MULTI_DROPPED, "MULTI TCP: output queue full, packet dropped");
+		}
+	      else
+#endif
+		mbuf_add_item (mi->tcp_link_out_deferred, &item);
 	      mbuf_free_buf (mb);
 	      buf_reset (buf);
 	      ret = multi_process_post (m, mi, mpp_flags);
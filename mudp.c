@@ -28,6 +28,7 @@
 
 #include "multi.h"
 #include "forward-inline.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -73,6 +74,7 @@ multi_get_create_instance_udp (struct multi_context *m)
 		}
 	      else
 		{
+		  ++metrics.reject[METRIC_REJECT_CONNECT_FREQ];
 		  msg (D_MULTI_ERRORS,
 		       "MULTI: Connection from %s would exceed new connection frequency limit as controlled by --connect-freq",
 		       mroute_addr_print (&real, &gc));
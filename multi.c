@@ -31,6 +31,7 @@
 #include "misc.h"
 #include "otime.h"
 #include "gremlin.h"
+#include "metrics.h"
 
 #include "memdbg.h"
 
@@ -303,6 +304,7 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
    * Allocate broadcast/multicast buffer list
    */
   m->mbuf = mbuf_init (t->options.n_bcast_buf);
+  mbuf_pool_init (BUF_SIZE (&t->c2.frame), t->options.n_bcast_buf);
 
   /*
    * Different status file format options are available
@@ -500,6 +502,8 @@ multi_close_instance (struct multi_context *m,
 
   ASSERT (!mi->halt);
   mi->halt = true;
+  if (mi->connection_established_flag)
+    ++metrics.clients_closed;
 
   dmsg (D_MULTI_DEBUG, "MULTI: multi_close_instance called");
 
@@ -507,6 +511,10 @@ multi_close_instance (struct multi_context *m,
   m->n_clients += mi->n_clients_delta;
   mi->n_clients_delta = 0;
 
+  /* and the client memory sum */
+  m->client_memory -= mi->memory;
+  mi->memory = 0;
+
   /* prevent dangling pointers */
   if (m->pending == mi)
     multi_set_pending (m, NULL);
@@ -569,6 +577,46 @@ multi_close_instance (struct multi_context *m,
   perf_pop ();
 }
 
+/*
+ * A struct multi_instance embeds a complete struct context,
+ * so released instances are kept on a free list and handed
+ * out again on the next connect, rather than going through
+ * the heap on every connect/disconnect.
+ */
+#define MULTI_INSTANCE_CACHE_SIZE 32
+
+static struct multi_instance *multi_instance_cache[MULTI_INSTANCE_CACHE_SIZE]; /* GLOBAL */
+static int multi_instance_cache_len; /* GLOBAL */
+
+static struct multi_instance *
+multi_instance_alloc (void)
+{
+  struct multi_instance *mi;
+  if (multi_instance_cache_len > 0)
+    mi = multi_instance_cache[--multi_instance_cache_len]; /* cleared on release */
+  else
+    ALLOC_OBJ_CLEAR (mi, struct multi_instance);
+  return mi;
+}
+
+void
+multi_instance_release (struct multi_instance *mi)
+{
+  /* also scrubs key material held in the embedded context */
+  CLEAR (*mi);
+  if (multi_instance_cache_len < MULTI_INSTANCE_CACHE_SIZE)
+    multi_instance_cache[multi_instance_cache_len++] = mi;
+  else
+    free (mi);
+}
+
+static void
+multi_instance_cache_free (void)
+{
+  while (multi_instance_cache_len > 0)
+    free (multi_instance_cache[--multi_instance_cache_len]);
+}
+
 /*
  * Called on shutdown or restart.
  */
@@ -608,11 +656,13 @@ multi_uninit (struct multi_context *m)
 
 	  schedule_free (m->schedule);
 	  mbuf_free (m->mbuf);
+	  mbuf_pool_free ();
 	  ifconfig_pool_free (m->ifconfig_pool);
 	  frequency_limit_free (m->new_connection_limiter);
 	  multi_reap_free (m->reaper);
 	  mroute_helper_free (m->route_helper);
 	  multi_tcp_free (m->mtcp);
+	  multi_instance_cache_free ();
 	  m->thread_mode = MC_UNDEF;
 	}
     }
@@ -631,7 +681,7 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
 
   msg (D_MULTI_LOW, "MULTI: multi_create_instance called");
 
-  ALLOC_OBJ_CLEAR (mi, struct multi_instance);
+  mi = multi_instance_alloc ();
 
   mi->gc = gc_new ();
   multi_instance_inc_refcount (mi);
@@ -654,6 +704,7 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
 
   if (hash_n_elements (m->hash) >= m->max_clients)
     {
+      ++metrics.reject[METRIC_REJECT_MAX_CLIENTS];
       msg (D_MULTI_ERRORS, "MULTI: new incoming connection would exceed maximum number of clients (%d)", m->max_clients);
       goto err;
     }
@@ -699,6 +750,98 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
   return NULL;
 }
 
+void
+multi_instance_memory (const struct multi_instance *mi, struct multi_memory *mm)
+{
+  const struct context *c = &mi->context;
+
+  CLEAR (*mm);
+  mm->context = sizeof (*mi);
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  mm->tls = tls_multi_memory (c->c2.tls_multi);
+#endif
+#ifdef USE_LZO
+  mm->compress = lzo_memory (&c->c2.lzo_compwork);
+#endif
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    mm->fragment = fragment_memory (c->c2.fragment);
+#endif
+  mm->tcp_queue = mbuf_memory (mi->tcp_link_out_deferred);
+  if (c->c2.link_socket && c->c2.link_socket_owned)
+    {
+      const struct link_socket *ls = c->c2.link_socket;
+      mm->link = sizeof (*ls) + ls->stream_buf_data.capacity + ls->stream_buf.residual.capacity;
+    }
+  mm->total = mm->context + mm->tls + mm->compress + mm->fragment + mm->tcp_queue + mm->link;
+}
+
+/*
+ * Measure mi again into mm and fold the difference
+ * into the client memory sum reported by load-stats.
+ */
+static void
+multi_instance_memory_update (struct multi_context *m, struct multi_instance *mi, struct multi_memory *mm)
+{
+  multi_instance_memory (mi, mm);
+  m->client_memory += mm->total - mi->memory;
+  mi->memory = mm->total;
+  mi->memory_checked = now;
+}
+
+/*
+ * Print per-client memory accounting, in the
+ * style of the given status version, bringing
+ * the client memory sum up to date on the way.
+ */
+static void
+multi_print_memory (struct multi_context *m, struct status_output *so, const int version)
+{
+  const char sep = (version == 3) ? '\t' : ',';
+  char prefix[32];
+  struct hash_iterator hi;
+  const struct hash_element *he;
+
+  if (version == 1)
+    {
+      prefix[0] = '\0';
+      status_printf (so, "CLIENT MEMORY");
+      status_printf (so, "Common Name,Real Address,Total,Context,TLS,Compression,Fragment,TCP Queue,Link");
+    }
+  else
+    {
+      openvpn_snprintf (prefix, sizeof (prefix), "CLIENT_MEMORY%c", sep);
+      status_printf (so, "HEADER%cCLIENT_MEMORY%cCommon Name%cReal Address%cTotal%cContext%cTLS%cCompression%cFragment%cTCP Queue%cLink",
+		     sep, sep, sep, sep, sep, sep, sep, sep, sep, sep);
+    }
+
+  hash_iterator_init (m->hash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      struct gc_arena gc = gc_new ();
+      struct multi_instance *mi = (struct multi_instance *) he->value;
+
+      if (!mi->halt)
+	{
+	  struct multi_memory mm;
+	  multi_instance_memory_update (m, mi, &mm);
+	  status_printf (so, "%s%s%c%s%c%lu%c%lu%c%lu%c%lu%c%lu%c%lu%c%lu",
+			 prefix,
+			 tls_common_name (mi->context.c2.tls_multi, false),
+			 sep, mroute_addr_print (&mi->real, &gc),
+			 sep, (unsigned long) mm.total,
+			 sep, (unsigned long) mm.context,
+			 sep, (unsigned long) mm.tls,
+			 sep, (unsigned long) mm.compress,
+			 sep, (unsigned long) mm.fragment,
+			 sep, (unsigned long) mm.tcp_queue,
+			 sep, (unsigned long) mm.link);
+	}
+      gc_free (&gc);
+    }
+  hash_iterator_free (&hi);
+}
+
 /*
  * Dump tables -- triggered by SIGUSR2.
  * If status file is defined, write to file.
@@ -769,10 +912,22 @@ multi_print_status (struct multi_context *m, struct status_output *so, const int
 	    }
 	  hash_iterator_free (&hi);
 
+	  multi_print_memory (m, so, version);
+
 	  status_printf (so, "GLOBAL STATS");
 	  if (m->mbuf)
 	    status_printf (so, "Max bcast/mcast queue length,%d",
 			   mbuf_maximum_queued (m->mbuf));
+	  status_printf (so, "Client memory bytes,%lu",
+			 (unsigned long) m->client_memory);
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+	  {
+	    int reneg_pending, reneg_active;
+	    tls_reneg_status (&reneg_pending, &reneg_active);
+	    status_printf (so, "Renegotiations pending,%d", reneg_pending);
+	    status_printf (so, "Renegotiations in progress,%d", reneg_active);
+	  }
+#endif
 
 	  status_printf (so, "END");
 	}
@@ -835,9 +990,23 @@ multi_print_status (struct multi_context *m, struct status_output *so, const int
 	    }
 	  hash_iterator_free (&hi);
 
+	  multi_print_memory (m, so, version);
+
 	  if (m->mbuf)
 	    status_printf (so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
 			   sep, sep, mbuf_maximum_queued (m->mbuf));
+	  status_printf (so, "GLOBAL_STATS%cClient memory bytes%c%lu",
+			 sep, sep, (unsigned long) m->client_memory);
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+	  {
+	    int reneg_pending, reneg_active;
+	    tls_reneg_status (&reneg_pending, &reneg_active);
+	    status_printf (so, "GLOBAL_STATS%cRenegotiations pending%c%d",
+			   sep, sep, reneg_pending);
+	    status_printf (so, "GLOBAL_STATS%cRenegotiations in progress%c%d",
+			   sep, sep, reneg_active);
+	  }
+#endif
 
 	  status_printf (so, "END");
 	}
@@ -990,6 +1159,7 @@ multi_get_instance_by_virtual_addr (struct multi_context *m,
       struct multi_instance *mi = route->instance;
       route->last_reference = now;
       ret = mi;
+      ++metrics.route_cache_hits;
     }
   else if (cidr_routing) /* do we need to regenerate a host route cache entry? */
     {
@@ -997,6 +1167,8 @@ multi_get_instance_by_virtual_addr (struct multi_context *m,
       struct mroute_addr tryaddr;
       int i;
 
+      ++metrics.route_cache_misses;
+
       /* cycle through each CIDR length */
       for (i = 0; i < rh->n_net_len; ++i)
 	{
@@ -1696,6 +1868,13 @@ multi_connection_established (struct multi_context *m, struct multi_instance *mi
       /* increment number of current authenticated clients */
       ++m->n_clients;
       --mi->n_clients_delta;
+      ++metrics.clients_established;
+
+      /* the handshake just released its control channel windows */
+      {
+	struct multi_memory mm;
+	multi_instance_memory_update (m, mi, &mm);
+      }
 
 #ifdef MANAGEMENT_DEF_AUTH
       if (management)
@@ -1729,6 +1908,7 @@ multi_add_mbuf (struct multi_context *m,
     }
   else
     {
+      metric_drop (METRIC_DROP_SATURATION);
       msg (D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_add_mbuf)");
     }
 }
@@ -1847,7 +2027,7 @@ static void
 multi_schedule_context_wakeup (struct multi_context *m, struct multi_instance *mi)
 {
   /* calculate an absolute wakeup time */
-  ASSERT (!openvpn_gettimeofday (&mi->wakeup, NULL));
+  openvpn_now_tv (&mi->wakeup);
   tv_add (&mi->wakeup, &mi->context.c2.timeval);
 
   /* tell scheduler to wake us up at some point in the future */
@@ -1900,6 +2080,18 @@ multi_process_post (struct multi_context *m, struct multi_instance *mi, const un
       /* continue to pend on output? */
       multi_set_pending (m, ANY_OUT (&mi->context) ? mi : NULL);
 
+      /*
+       * Keep the client memory sum current.  Measuring on
+       * every packet would cost more than the figure is worth,
+       * so a client is measured again at most once a second,
+       * besides when it is created, established or closed.
+       */
+      if (mi->memory_checked != now)
+	{
+	  struct multi_memory mm;
+	  multi_instance_memory_update (m, mi, &mm);
+	}
+
 #ifdef MULTI_DEBUG_EVENT_LOOP
       printf ("POST %s[%d] to=%d lo=%d/%d w=%d/%d\n",
 	      id(mi),
@@ -1985,6 +2177,7 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 	      /* make sure that source address is associated with this client */
 	      else if (multi_get_instance_by_virtual_addr (m, &src, true) != m->pending)
 		{
+		  metric_drop (METRIC_DROP_BAD_SOURCE);
 		  msg (D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
 		       mroute_addr_print (&src, &gc));
 		  c->c2.to_tun.len = 0;
@@ -2094,6 +2287,7 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 		    }
 		  else
 		    {
+		      metric_drop (METRIC_DROP_BAD_SOURCE);
 		      msg (D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
 			   mroute_addr_print (&src, &gc));
 		      c->c2.to_tun.len = 0;
@@ -2212,6 +2406,7 @@ multi_process_incoming_tun (struct multi_context *m, const unsigned int mpp_flag
 		    else
 		      {
 			/* drop packet */
+			metric_drop (METRIC_DROP_SATURATION);
 			msg (D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_process_incoming_tun)");
 			buf_reset_len (&c->c2.buf);
 		      }
@@ -2375,6 +2570,12 @@ multi_process_per_second_timers_dowork (struct multi_context *m)
   /* possibly flush ifconfig-pool file */
   multi_ifconfig_pool_persist (m, false);
 
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  /* pick up a changed --crl-verify file */
+  if (m->top.c1.ks.crl_index)
+    crl_index_update (m->top.c1.ks.crl_index);
+#endif
+
 #ifdef ENABLE_DEBUG
   gremlin_flood_clients (m);
 #endif
@@ -2485,6 +2686,31 @@ management_callback_kill_by_cn (void *arg, const char *del_cn)
   return count;
 }
 
+static size_t
+management_callback_client_memory (void *arg)
+{
+  return ((struct multi_context *) arg)->client_memory;
+}
+
+static void
+management_callback_metrics (void *arg, const int msglevel)
+{
+  struct multi_context *m = (struct multi_context *) arg;
+
+  msg (msglevel, "# TYPE openvpn_clients gauge");
+  msg (msglevel, "openvpn_clients %d", hash_n_elements (m->hash));
+  msg (msglevel, "# TYPE openvpn_max_clients gauge");
+  msg (msglevel, "openvpn_max_clients %d", m->max_clients);
+  msg (msglevel, "# TYPE openvpn_routes gauge");
+  msg (msglevel, "openvpn_routes %d", hash_n_elements (m->vhash));
+  msg (msglevel, "# TYPE openvpn_scheduled_events gauge");
+  msg (msglevel, "openvpn_scheduled_events %d", m->schedule->size);
+  msg (msglevel, "# TYPE openvpn_bcast_queue_length gauge");
+  msg (msglevel, "openvpn_bcast_queue_length %u", m->mbuf->len);
+  msg (msglevel, "# TYPE openvpn_bcast_queue_max_length gauge");
+  msg (msglevel, "openvpn_bcast_queue_max_length %d", mbuf_maximum_queued (m->mbuf));
+}
+
 static int
 management_callback_kill_by_addr (void *arg, const in_addr_t addr, const int port)
 {
@@ -2648,6 +2874,8 @@ init_management_callback_multi (struct multi_context *m)
       cb.kill_by_addr = management_callback_kill_by_addr;
       cb.delete_event = management_delete_event;
       cb.n_clients = management_callback_n_clients;
+      cb.client_memory = management_callback_client_memory;
+      cb.metrics = management_callback_metrics;
 #ifdef MANAGEMENT_DEF_AUTH
       cb.kill_by_cid = management_kill_by_cid;
       cb.client_auth = management_client_auth;
@@ -69,6 +69,7 @@ struct multi_instance {
   /* queued outgoing data in Server/TCP mode */
   unsigned int tcp_rwflags;
   struct mbuf_set *tcp_link_out_deferred;
+  int tcp_link_out_partial;    /* bytes of the queue head already written */
   bool socket_set_called;
 
   in_addr_t reporting_addr;       /* IP address shown in status listing */
@@ -83,6 +84,8 @@ struct multi_instance {
   bool connection_established_flag;
   bool did_iroutes;
   int n_clients_delta; /* added to multi_context.n_clients when instance is closed */
+  size_t memory;       /* our share of multi_context.client_memory */
+  time_t memory_checked; /* when memory was last measured */
 
   struct context context;
 };
@@ -115,6 +118,7 @@ struct multi_context {
   int tcp_queue_limit;
   int status_file_version;
   int n_clients; /* current number of authenticated clients */
+  size_t client_memory; /* sum of multi_instance.memory over all clients */
 
 #ifdef MANAGEMENT_DEF_AUTH
   struct hash *cid_hash;
@@ -181,6 +185,22 @@ void multi_process_drop_outgoing_tun (struct multi_context *m, const unsigned in
 
 void multi_print_status (struct multi_context *m, struct status_output *so, const int version);
 
+/*
+ * Approximate heap footprint of a client instance, by subsystem.
+ */
+struct multi_memory
+{
+  size_t context;     /* struct multi_instance, including its struct context */
+  size_t tls;         /* control channel state and reliability windows */
+  size_t compress;    /* compression workspace */
+  size_t fragment;    /* fragment reassembly and output buffers */
+  size_t tcp_queue;   /* deferred TCP output queue */
+  size_t link;        /* own TCP socket and its stream read buffers */
+  size_t total;
+};
+
+void multi_instance_memory (const struct multi_instance *mi, struct multi_memory *mm);
+
 struct multi_instance *multi_get_queue (struct mbuf_set *ms);
 
 void multi_add_mbuf (struct multi_context *m,
@@ -261,6 +281,8 @@ route_quota_test (const struct multi_context *m, const struct multi_instance *mi
  * Instance reference counting
  */
 
+void multi_instance_release (struct multi_instance *mi);
+
 static inline void
 multi_instance_inc_refcount (struct multi_instance *mi)
 {
@@ -273,7 +295,7 @@ multi_instance_dec_refcount (struct multi_instance *mi)
   if (--mi->refcount <= 0)
     {
       gc_free (&mi->gc);
-      free (mi);
+      multi_instance_release (mi);
     }
 }
 
@@ -381,7 +403,7 @@ multi_get_timeout (struct multi_context *m, struct timeval *dest)
   m->earliest_wakeup = (struct multi_instance *) schedule_get_earliest_wakeup (m->schedule, &tv);
   if (m->earliest_wakeup)
     {
-      ASSERT (!openvpn_gettimeofday (&current, NULL));
+      openvpn_now_tv (&current);
       tv_delta (dest, &current, &tv);
       if (dest->tv_sec >= REAP_MAX_WAKEUP)
 	{
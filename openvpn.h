@@ -66,6 +66,12 @@ struct key_schedule
   /* our global SSL context */
   SSL_CTX *ssl_ctx;
 
+  /* in-memory --crl-verify file */
+  struct crl_index *crl_index;
+
+  /* --verify-cache of verified peer certificate chains */
+  struct verify_cache *verify_cache;
+
   /* optional authentication HMAC key for TLS control channel */
   struct key_ctx_bi tls_auth_key;
 
@@ -67,6 +67,9 @@ const char title_string[] =
 #ifdef USE_LZO
   " [LZO" LZO_VERSION_NUM "]"
 #endif
+#ifdef USE_LZ4
+  " [LZ4]"
+#endif
 #if EPOLL
   " [EPOLL]"
 #endif
@@ -233,6 +236,8 @@ static const char usage_message[] =
   "--multihome     : Configure a multi-homed UDP server.\n"
 #endif
   "--fast-io       : (experimental) Optimize TUN/TAP/UDP writes.\n"
+  "--perf-stats    : Record per-stage latency histograms, shown at exit and by\n"
+  "                  the management interface 'perf' command.\n"
   "--remap-usr1 s  : On SIGUSR1 signals, remap signal (s='SIGHUP' or 'SIGTERM').\n"
   "--persist-tun   : Keep tun/tap device open across SIGUSR1 or --ping-restart.\n"
   "--persist-remote-ip : Keep remote IP address across SIGUSR1 or --ping-restart.\n"
@@ -325,6 +330,10 @@ static const char usage_message[] =
   "                  packet for uncompressible data.\n"
   "--comp-noadapt  : Don't use adaptive compression when --comp-lzo\n"
   "                  is specified.\n"
+#ifdef USE_LZ4
+  "--comp-lz4      : Like --comp-lzo, but use LZ4 compression, which\n"
+  "                  decompresses faster.\n"
+#endif
 #endif
 #ifdef ENABLE_MANAGEMENT
   "--management ip port [pass] : Enable a TCP server on ip:port to handle\n"
@@ -482,6 +491,11 @@ static const char usage_message[] =
   "                  using file.\n"
   "--test-crypto   : Run a self-test of crypto features enabled.\n"
   "                  For debugging only.\n"
+  "--benchmark [n] [size ...] : Time compression and crypto of n packets\n"
+  "                  (default=100000) of each size, without a peer, and\n"
+  "                  print CSV results to stderr.  Uses a random key\n"
+  "                  if --secret is not given.\n"
+  "--benchmark-output file : Write --benchmark results to file instead.\n"
 #ifdef USE_SSL
   "\n"
   "TLS Key Negotiation Options:\n"
@@ -519,9 +533,15 @@ static const char usage_message[] =
   "                : Use --show-tls to see a list of supported TLS ciphers.\n"
   "--tls-timeout n : Packet retransmit timeout on TLS control channel\n"
   "                  if no ACK from remote within n seconds (default=%d).\n"
+  "--tls-window n  : Max unacknowledged packets in flight on TLS control\n"
+  "                  channel (default=%d), must match the peer's.\n"
   "--reneg-bytes n : Renegotiate data chan. key after n bytes sent and recvd.\n"
   "--reneg-pkts n  : Renegotiate data chan. key after n packets sent and recvd.\n"
   "--reneg-sec n   : Renegotiate data chan. key after n seconds (default=%d).\n"
+  "--reneg-jitter n: Server: randomly advance each key's --reneg-sec deadline\n"
+  "                  by up to n seconds to spread out renegotiations.\n"
+  "--reneg-max-rate n : Server: start at most n renegotiations per second,\n"
+  "                  deferring the rest (default=0 -- unlimited).\n"
   "--hand-window n : Data channel key exchange must finalize within n seconds\n"
   "                  of handshake initiation by any peer (default=%d).\n"
   "--tran-window n : Transition window -- old key can live this many seconds\n"
@@ -536,6 +556,9 @@ static const char usage_message[] =
   "--askpass [file]: Get PEM password from controlling tty before we daemonize.\n"
   "--auth-nocache  : Don't cache --askpass or --auth-user-pass passwords.\n"
   "--crl-verify crl: Check peer certificate against a CRL.\n"
+  "--verify-cache n [s] : Remember up to n peer certificate chains which passed\n"
+  "                  verification for s seconds (default=%d), and skip\n"
+  "                  --tls-verify, CRL and extension checks for them.\n"
   "--tls-verify cmd: Execute shell command cmd to verify the X509 name of a\n"
   "                  pending TLS connection that has otherwise passed all other\n"
   "                  tests of certification.  cmd should return 0 to allow\n"
@@ -761,6 +784,8 @@ init_options (struct options *o, const bool init_gc)
 #ifdef USE_SSL
   o->key_method = 2;
   o->tls_timeout = 2;
+  o->tls_window = TLS_RELIABLE_N_SEND_BUFFERS;
+  o->verify_cache_ttl = 7200;
   o->renegotiate_seconds = 3600;
   o->handshake_window = 60;
   o->transition_window = 3600;
@@ -1285,9 +1310,11 @@ show_settings (const struct options *o)
   SHOW_INT (sockflags);
 
   SHOW_BOOL (fast_io);
+  SHOW_BOOL (perf_stats);
 
 #ifdef USE_LZO
   SHOW_INT (lzo);
+  SHOW_INT (comp_alg);
 #endif
 
   SHOW_STR (route_script);
@@ -1338,6 +1365,9 @@ show_settings (const struct options *o)
   SHOW_STR (packet_id_file);
   SHOW_BOOL (use_iv);
   SHOW_BOOL (test_crypto);
+  SHOW_INT (benchmark_packets);
+  SHOW_INT (benchmark_n_sizes);
+  SHOW_STR (benchmark_output);
 
 #ifdef USE_SSL
   SHOW_BOOL (tls_server);
@@ -1357,6 +1387,8 @@ show_settings (const struct options *o)
   SHOW_STR (tls_export_cert);
   SHOW_STR (tls_remote);
   SHOW_STR (crl_file);
+  SHOW_INT (verify_cache_size);
+  SHOW_INT (verify_cache_ttl);
   SHOW_INT (ns_cert_type);
   {
     int i;
@@ -1366,10 +1398,13 @@ show_settings (const struct options *o)
   SHOW_STR (remote_cert_eku);
 
   SHOW_INT (tls_timeout);
+  SHOW_INT (tls_window);
 
   SHOW_INT (renegotiate_bytes);
   SHOW_INT (renegotiate_packets);
   SHOW_INT (renegotiate_seconds);
+  SHOW_INT (renegotiate_jitter);
+  SHOW_INT (renegotiate_max_rate);
 
   SHOW_INT (handshake_window);
   SHOW_INT (transition_window);
@@ -1655,7 +1690,8 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 #ifdef USE_CRYPTO
   if (options->test_crypto)
     {
-      notnull (options->shared_secret_file, "key file (--secret)");
+      if (!options->benchmark_packets)
+	notnull (options->shared_secret_file, "key file (--secret)");
     }
   else
 #endif
@@ -2084,9 +2120,12 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
       MUST_BE_UNDEF (tls_export_cert);
       MUST_BE_UNDEF (tls_remote);
       MUST_BE_UNDEF (tls_timeout);
+      MUST_BE_UNDEF (tls_window);
       MUST_BE_UNDEF (renegotiate_bytes);
       MUST_BE_UNDEF (renegotiate_packets);
       MUST_BE_UNDEF (renegotiate_seconds);
+      MUST_BE_UNDEF (renegotiate_jitter);
+      MUST_BE_UNDEF (renegotiate_max_rate);
       MUST_BE_UNDEF (handshake_window);
       MUST_BE_UNDEF (transition_window);
       MUST_BE_UNDEF (tls_auth_file);
@@ -2096,6 +2135,7 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 #endif
       MUST_BE_UNDEF (tls_exit);
       MUST_BE_UNDEF (crl_file);
+      MUST_BE_UNDEF (verify_cache_size);
       MUST_BE_UNDEF (key_method);
       MUST_BE_UNDEF (ns_cert_type);
       MUST_BE_UNDEF (remote_cert_ku[0]);
@@ -2406,7 +2446,7 @@ pre_pull_restore (struct options *o)
  * --ifconfig x y [matched with --ifconfig y x on
  *                 the other end of the connection]
  *
- * --comp-lzo
+ * --comp-lzo or --comp-lz4
  * --fragment
  *
  * Crypto Options:
@@ -2483,7 +2523,7 @@ options_string (const struct options *o,
 
 #ifdef USE_LZO
   if (o->lzo & LZO_SELECTED)
-    buf_printf (&out, ",comp-lzo");
+    buf_printf (&out, o->comp_alg == COMP_ALG_LZ4 ? ",comp-lz4" : ",comp-lzo");
 #endif
 
 #ifdef ENABLE_FRAGMENT
@@ -2889,8 +2929,9 @@ usage (void)
 	   o.verbosity,
 	   o.authname, o.ciphername,
            o.replay_window, o.replay_time,
-	   o.tls_timeout, o.renegotiate_seconds,
-	   o.handshake_window, o.transition_window);
+	   o.tls_timeout, o.tls_window, o.renegotiate_seconds,
+	   o.handshake_window, o.transition_window,
+	   o.verify_cache_ttl);
 #elif defined(USE_CRYPTO)
   fprintf (fp, usage_message,
 	   title_string,
@@ -4317,6 +4358,11 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->fast_io = true;
     }
+  else if (streq (p[0], "perf-stats"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->perf_stats = true;
+    }
   else if (streq (p[0], "inactive") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_TIMER);
@@ -5433,7 +5479,11 @@ add_option (struct options *options,
     }
 #endif
 #ifdef USE_LZO
-  else if (streq (p[0], "comp-lzo"))
+  else if (streq (p[0], "comp-lzo")
+#ifdef USE_LZ4
+	   || streq (p[0], "comp-lz4")
+#endif
+	   )
     {
       VERIFY_PERMISSION (OPT_P_COMP);
       if (p[1])
@@ -5446,12 +5496,13 @@ add_option (struct options *options,
 	    options->lzo = LZO_SELECTED|LZO_ON|LZO_ADAPTIVE;
 	  else
 	    {
-	      msg (msglevel, "bad comp-lzo option: %s -- must be 'yes', 'no', or 'adaptive'", p[1]);
+	      msg (msglevel, "bad %s option: %s -- must be 'yes', 'no', or 'adaptive'", p[0], p[1]);
 	      goto err;
 	    }
 	}
       else
 	options->lzo = LZO_SELECTED|LZO_ON|LZO_ADAPTIVE;
+      options->comp_alg = streq (p[0], "comp-lz4") ? COMP_ALG_LZ4 : COMP_ALG_LZO;
     }
   else if (streq (p[0], "comp-noadapt"))
     {
@@ -5631,6 +5682,44 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->test_crypto = true;
     }
+  else if (streq (p[0], "benchmark"))
+    {
+      int i;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->test_crypto = true;
+      options->benchmark_packets = 100000;
+      options->benchmark_n_sizes = 0;
+      if (p[1])
+	{
+	  options->benchmark_packets = positive_atoi (p[1]);
+	  if (options->benchmark_packets < 1)
+	    {
+	      msg (msglevel, "--benchmark packet count must be > 0");
+	      goto err;
+	    }
+	}
+      for (i = 2; i < MAX_PARMS && p[i]; ++i)
+	{
+	  const int size = positive_atoi (p[i]);
+	  if (options->benchmark_n_sizes >= BENCHMARK_MAX_SIZES)
+	    {
+	      msg (msglevel, "--benchmark accepts at most %d packet sizes", BENCHMARK_MAX_SIZES);
+	      goto err;
+	    }
+	  if (size < 1)
+	    {
+	      msg (msglevel, "--benchmark packet size must be > 0");
+	      goto err;
+	    }
+	  options->benchmark_sizes[options->benchmark_n_sizes++] = size;
+	}
+    }
+  else if (streq (p[0], "benchmark-output") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->benchmark_output = p[1];
+    }
   else if (streq (p[0], "engine"))
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
@@ -5781,6 +5870,13 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->crl_file = p[1];
     }
+  else if (streq (p[0], "verify-cache") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->verify_cache_size = positive_atoi (p[1]);
+      if (p[2])
+	options->verify_cache_ttl = positive_atoi (p[2]);
+    }
   else if (streq (p[0], "tls-verify") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_SCRIPT);
@@ -5856,6 +5952,19 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
       options->tls_timeout = positive_atoi (p[1]);
     }
+  else if (streq (p[0], "tls-window") && p[1])
+    {
+      int window;
+
+      VERIFY_PERMISSION (OPT_P_TLS_PARMS);
+      window = atoi (p[1]);
+      if (window < 1 || window > RELIABLE_CAPACITY)
+	{
+	  msg (msglevel, "--tls-window parameter must be between 1 and %d", RELIABLE_CAPACITY);
+	  goto err;
+	}
+      options->tls_window = window;
+    }
   else if (streq (p[0], "reneg-bytes") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
@@ -5871,6 +5980,16 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
       options->renegotiate_seconds = positive_atoi (p[1]);
     }
+  else if (streq (p[0], "reneg-jitter") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_TLS_PARMS);
+      options->renegotiate_jitter = positive_atoi (p[1]);
+    }
+  else if (streq (p[0], "reneg-max-rate") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_TLS_PARMS);
+      options->renegotiate_max_rate = positive_atoi (p[1]);
+    }
   else if (streq (p[0], "hand-window") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
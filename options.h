@@ -304,9 +304,15 @@ struct options
   /* optimize TUN/TAP/UDP writes */
   bool fast_io;
 
+  /* --perf-stats: record per-stage latency histograms */
+  bool perf_stats;
+
 #ifdef USE_LZO
   /* LZO_x flags from lzo.h */
   unsigned int lzo;
+
+  /* COMP_ALG_x from lzo.h */
+  int comp_alg;
 #endif
 
   /* buffer sizes */
@@ -452,6 +458,13 @@ struct options
   bool use_iv;
   bool test_crypto;
 
+  /* --benchmark: packets per size and packet sizes, implies test_crypto */
+# define BENCHMARK_MAX_SIZES 8
+  int benchmark_packets;
+  int benchmark_sizes[BENCHMARK_MAX_SIZES];
+  int benchmark_n_sizes;
+  const char *benchmark_output;	/* CSV results go here, stderr if NULL */
+
 #ifdef USE_SSL
   /* TLS (control channel) parms */
   bool tls_server;
@@ -467,6 +480,8 @@ struct options
   const char *tls_export_cert;
   const char *tls_remote;
   const char *crl_file;
+  int verify_cache_size;
+  int verify_cache_ttl;
 
 #if ENABLE_INLINE_FILES
   const char *ca_file_inline;
@@ -500,11 +515,19 @@ struct options
   /* Per-packet timeout on control channel */
   int tls_timeout;
 
+  /* Max unacknowledged packets in flight on control channel */
+  int tls_window;
+
   /* Data channel key renegotiation parameters */
   int renegotiate_bytes;
   int renegotiate_packets;
   int renegotiate_seconds;
 
+  /* Server-side spreading of renegotiations: random advance
+     of the --reneg-sec deadline, and max soft resets per second */
+  int renegotiate_jitter;
+  int renegotiate_max_rate;
+
   /* Data channel key handshake must finalize
      within n seconds of handshake initiation. */
   int handshake_window;
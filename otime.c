@@ -30,7 +30,50 @@
 
 time_t now = 0;            /* GLOBAL */
 
-#if TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY)
+#ifdef TIME_MONOTONIC
+
+time_t now_usec = 0;             /* GLOBAL */
+static time_t now_base = 0;      /* GLOBAL */
+static bool now_base_set = false; /* GLOBAL */
+static clockid_t now_clock = OPENVPN_CLOCK;               /* GLOBAL */
+static clockid_t now_clock_coarse = OPENVPN_CLOCK_COARSE; /* GLOBAL */
+
+void
+update_now_monotonic (const bool coarse)
+{
+  struct timespec ts;
+  time_t sec, usec;
+
+  if (clock_gettime (coarse ? now_clock_coarse : now_clock, &ts))
+    {
+#ifdef CLOCK_BOOTTIME
+      /* headers may know CLOCK_BOOTTIME while the kernel doesn't */
+      if (now_clock != CLOCK_BOOTTIME)
+	return;
+      now_clock = now_clock_coarse = CLOCK_MONOTONIC;
+      if (clock_gettime (now_clock, &ts))
+#endif
+	return;
+    }
+
+  /* anchor to the wall clock on first use */
+  if (!now_base_set)
+    {
+      now_base = time (NULL) - ts.tv_sec;
+      now_base_set = true;
+    }
+
+  /* the coarse clock may lag a precise reading we already took */
+  sec = now_base + ts.tv_sec;
+  usec = ts.tv_nsec / 1000;
+  if (sec > now || (sec == now && usec > now_usec))
+    {
+      now = sec;
+      now_usec = usec;
+    }
+}
+
+#elif TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY)
 
 static time_t now_adj = 0; /* GLOBAL */
 time_t now_usec = 0;       /* GLOBAL */
@@ -70,7 +113,7 @@ update_now_usec (struct timeval *tv)
     now_usec = tv->tv_usec;
 }
 
-#endif /* TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY) */
+#endif /* TIME_MONOTONIC */
 
 /* 
  * Return a numerical string describing a struct timeval.
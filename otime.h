@@ -57,7 +57,38 @@ extern time_t now; /* updated frequently to time(NULL) */
 
 void time_test (void);
 
-#if TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY)
+#ifdef TIME_MONOTONIC
+
+/*
+ * now and now_usec follow OPENVPN_CLOCK (CLOCK_BOOTTIME or
+ * CLOCK_MONOTONIC), offset so that now matches the wall clock
+ * at startup.  They never go backwards and ignore later changes
+ * to the system clock, but do include time spent suspended
+ * where CLOCK_BOOTTIME is available.
+ *
+ * update_time reads the coarse clock, once per event loop
+ * pass; openvpn_gettimeofday reads the precise one for
+ * callers that need microseconds.
+ */
+extern time_t now_usec;
+void update_now_monotonic (const bool coarse);
+
+static inline void
+update_time (void)
+{
+  update_now_monotonic (true);
+}
+
+static inline int
+openvpn_gettimeofday (struct timeval *tv, void *tz)
+{
+  update_now_monotonic (false);
+  tv->tv_sec = now;
+  tv->tv_usec = now_usec;
+  return 0;
+}
+
+#elif TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY)
 
 void update_now (const time_t system_time);
 
@@ -118,7 +149,7 @@ openvpn_gettimeofday (struct timeval *tv, void *tz)
 
 #endif
 
-#endif /* TIME_BACKTRACK_PROTECTION && defined(HAVE_GETTIMEOFDAY) */
+#endif /* TIME_MONOTONIC */
 
 static inline time_t
 openvpn_time (time_t *t)
@@ -129,6 +160,29 @@ openvpn_time (time_t *t)
   return now;
 }
 
+/*
+ * Time of the last update_time(), for timer code that runs
+ * right after the event loop has refreshed the clock.  Only
+ * free of a clock read with TIME_MONOTONIC.
+ */
+static inline void
+openvpn_now_tv (struct timeval *tv)
+{
+#ifdef TIME_MONOTONIC
+  tv->tv_sec = now;
+  tv->tv_usec = now_usec;
+#elif defined(HAVE_GETTIMEOFDAY)
+  if (openvpn_gettimeofday (tv, NULL))
+    {
+      tv->tv_sec = now;
+      tv->tv_usec = 0;
+    }
+#else
+  tv->tv_sec = now;
+  tv->tv_usec = 0;
+#endif
+}
+
 static inline void
 tv_clear (struct timeval *tv)
 {
@@ -56,234 +56,251 @@ static const char *metric_names[] = {
   "PERF_PROC_OUT_TUN_MTCP"
 };
 
-struct perf
+#define PERF_HIST_SUB  (1 << PERF_HIST_SUB_BITS)
+#define PERF_HIST_N    (PERF_HIST_SUB * (PERF_HIST_MAX_BITS - PERF_HIST_SUB_BITS + 1))
+#define PERF_HIST_MAX  ((((uint64_t)1) << PERF_HIST_MAX_BITS) - 1)
+
+struct perf_hist
+{
+  counter_type count;
+  uint64_t sum;
+  uint64_t max;
+  counter_type bucket[PERF_HIST_N];
+};
+
+/*
+ * A stack frame meters the time spent in one stage,
+ * excluding the time spent in stages pushed above it.
+ */
+struct perf_frame
 {
-# define PS_INITIAL            0
-# define PS_METER_RUNNING      1
-# define PS_METER_INTERRUPTED  2
-  int state;
-
-  struct timeval start;
-  double sofar;
-  double sum;
-  double max;
-  double count;
+  int type;
+  uint64_t start;
+  uint64_t sofar;
 };
 
 struct perf_set
 {
   int stack_len;
-  int stack[STACK_N];
-  struct perf perf[PERF_N];
+  struct perf_frame stack[STACK_N];
+  struct perf_hist *hist;	/* PERF_N histograms, allocated on first enable */
 };
 
-static struct perf_set perf_set;
-
-static void perf_print_state (int lev);
+bool perf_enabled = false;         /* GLOBAL */
+static struct perf_set perf_set;   /* GLOBAL */
 
-static inline int
-get_stack_index (int sdelta)
+/* monotonic nanoseconds */
+static inline uint64_t
+perf_clock (void)
 {
-  const int sindex = perf_set.stack_len + sdelta;
-  if (sindex >= 0 && sindex < STACK_N)
-    return sindex;
-  else
-    return -1;
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#elif defined(HAVE_GETTIMEOFDAY)
+  struct timeval tv;
+  gettimeofday (&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#else
+  return (uint64_t) time (NULL) * 1000000000;
+#endif
 }
 
-static int
-get_perf_index (int sdelta)
+static inline int
+perf_log2 (uint64_t v)
 {
-  const int sindex = get_stack_index (sdelta);
-  if (sindex >= 0)
-    {
-      const int pindex = perf_set.stack[sindex];
-      if (pindex >= 0 && pindex < PERF_N)
-	return pindex;
-      else
-	return -1;
-    }
-  else
-    return -1;
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll (v);
+#else
+  int ret = 0;
+  while (v >>= 1)
+    ++ret;
+  return ret;
+#endif
 }
 
-static struct perf *
-get_perf (int sdelta)
+static inline int
+perf_hist_index (uint64_t v)
 {
-  const int pindex = get_perf_index (sdelta);
-  if (pindex >= 0)
-    return &perf_set.perf[pindex];
+  if (v < PERF_HIST_SUB)
+    return (int) v;
   else
-    return NULL;
-}
-
-static void
-push_perf_index (int pindex)
-{
-  const int sindex = get_stack_index (0);
-  const int newlen = get_stack_index (1);
-  if (sindex >= 0 && newlen >= 0
-      && pindex >= 0 && pindex < PERF_N)
     {
-      int i;
-      for (i = 0; i < sindex; ++i)
-	if (perf_set.stack[i] == pindex)
-	  {
-	    perf_print_state (M_INFO);
-	    msg (M_FATAL, "PERF: push_perf_index %s failed",
-		 metric_names [pindex]); 
-	  }
-
-      perf_set.stack[sindex] = pindex;
-      perf_set.stack_len = newlen;
+      int shift;
+      if (v > PERF_HIST_MAX)
+	v = PERF_HIST_MAX;
+      shift = perf_log2 (v) - PERF_HIST_SUB_BITS;
+      return PERF_HIST_SUB * (shift + 1) + (int) ((v >> shift) - PERF_HIST_SUB);
     }
-  else
-    msg (M_FATAL, "PERF: push_perf_index: stack push error"); 
 }
 
-static void
-pop_perf_index (void)
+/* largest value that maps to bucket i */
+static uint64_t
+perf_hist_value (const int i)
 {
-  const int newlen = get_stack_index (-1);
-  if (newlen >= 0)
+  if (i < PERF_HIST_SUB)
+    return i;
+  else
     {
-      perf_set.stack_len = newlen;
+      const int shift = i / PERF_HIST_SUB - 1;
+      const uint64_t sub = i % PERF_HIST_SUB;
+      return ((PERF_HIST_SUB + sub + 1) << shift) - 1;
     }
-  else
-    msg (M_FATAL, "PERF: pop_perf_index: stack pop error"); 
 }
 
 static void
-state_must_be (const struct perf *p, const int wanted)
+perf_record (const int type, const uint64_t ns)
 {
-  if (p->state != wanted)
-    msg (M_FATAL, "PERF: bad state actual=%d wanted=%d",
-	 p->state,
-	 wanted);
+  struct perf_hist *h = &perf_set.hist[type];
+  ++h->count;
+  h->sum += ns;
+  if (ns > h->max)
+    h->max = ns;
+  ++h->bucket[perf_hist_index (ns)];
 }
 
-static void
-update_sofar (struct perf *p)
+void
+perf_push_dowork (int type)
 {
-  struct timeval current;
-  ASSERT (!gettimeofday (&current, NULL));
-  p->sofar += (double) tv_subtract (&current, &p->start, 600) / 1000000.0;
-  tv_clear (&p->start);
-}
+  const uint64_t current = perf_clock ();
+  int i;
 
-static void
-perf_start (struct perf *p)
-{
-  state_must_be (p, PS_INITIAL);
-  ASSERT (!gettimeofday (&p->start, NULL));
-  p->sofar = 0.0;
-  p->state = PS_METER_RUNNING;
-}
+  if (type < 0 || type >= PERF_N)
+    return;
 
-static void
-perf_stop (struct perf *p)
-{
-  state_must_be (p, PS_METER_RUNNING);
-  update_sofar (p);
-  p->sum += p->sofar;
-  if (p->sofar > p->max)
-    p->max = p->sofar;
-  p->count += 1.0;
-  p->sofar = 0.0;
-  p->state = PS_INITIAL;
-}
+  /*
+   * A stage that is already on the stack was left without
+   * a matching pop, e.g. when a signal broke out of the
+   * event loop.  Discard it and anything above it.
+   */
+  for (i = 0; i < perf_set.stack_len; ++i)
+    if (perf_set.stack[i].type == type)
+      {
+	perf_set.stack_len = i;
+	break;
+      }
 
-static void
-perf_interrupt (struct perf *p)
-{
-  state_must_be (p, PS_METER_RUNNING);
-  update_sofar (p);
-  p->state = PS_METER_INTERRUPTED;
-}
+  if (perf_set.stack_len > 0)
+    {
+      struct perf_frame *prev = &perf_set.stack[perf_set.stack_len - 1];
+      prev->sofar += current - prev->start;
+    }
 
-static void
-perf_resume (struct perf *p)
-{
-  state_must_be (p, PS_METER_INTERRUPTED);
-  ASSERT (!gettimeofday (&p->start, NULL));
-  p->state = PS_METER_RUNNING;
+  if (perf_set.stack_len < STACK_N)
+    {
+      struct perf_frame *f = &perf_set.stack[perf_set.stack_len++];
+      f->type = type;
+      f->start = current;
+      f->sofar = 0;
+    }
 }
 
 void
-perf_push (int type)
+perf_pop_dowork (void)
 {
-  struct perf *prev;
-  struct perf *cur;
+  const uint64_t current = perf_clock ();
 
-  ASSERT (SIZE(metric_names) == PERF_N);
-  push_perf_index (type);
-
-  prev = get_perf (-2);
-  cur = get_perf (-1);
-
-  ASSERT (cur);
+  /* pops without a push happen when metering was enabled mid-stage */
+  if (perf_set.stack_len > 0)
+    {
+      struct perf_frame *f = &perf_set.stack[--perf_set.stack_len];
+      perf_record (f->type, f->sofar + (current - f->start));
 
-  if (prev)
-    perf_interrupt (prev);
-  perf_start (cur);
+      if (perf_set.stack_len > 0)
+	perf_set.stack[perf_set.stack_len - 1].start = current;
+    }
 }
 
 void
-perf_pop (void)
+perf_enable (const bool enable)
 {
-  struct perf *prev;
-  struct perf *cur;
-
-  prev = get_perf (-2);
-  cur = get_perf (-1);
+  ASSERT (SIZE (metric_names) == PERF_N);
+  if (enable && !perf_set.hist)
+    ALLOC_ARRAY_CLEAR (perf_set.hist, struct perf_hist, PERF_N);
+  perf_set.stack_len = 0;
+  perf_enabled = enable;
+}
 
-  ASSERT (cur);
-  perf_stop (cur);
+void
+perf_reset (void)
+{
+  if (perf_set.hist)
+    memset (perf_set.hist, 0, sizeof (struct perf_hist) * PERF_N);
+}
 
-  if (prev)
-    perf_resume (prev);
+const char *
+perf_name (const int type)
+{
+  if (type >= 0 && type < PERF_N)
+    return metric_names[type];
+  else
+    return "PERF_UNDEF";
+}
 
-  pop_perf_index ();
+bool
+perf_get_summary (const int type, struct perf_summary *s)
+{
+  const double pct[] = { 0.50, 0.90, 0.99, 0.999 };
+  double *const out[] = { &s->p50, &s->p90, &s->p99, &s->p999 };
+  const struct perf_hist *h;
+  counter_type seen = 0;
+  int i, j = 0;
+
+  CLEAR (*s);
+  if (!perf_set.hist || type < 0 || type >= PERF_N)
+    return false;
+  h = &perf_set.hist[type];
+  if (!h->count)
+    return false;
+
+  s->count = h->count;
+  s->mean = (double) h->sum / h->count / 1000.0;
+  s->max = h->max / 1000.0;
+
+  for (i = 0; i < PERF_HIST_N && j < (int) SIZE (pct); ++i)
+    {
+      seen += h->bucket[i];
+      while (j < (int) SIZE (pct) && seen >= pct[j] * h->count)
+	{
+	  uint64_t v = perf_hist_value (i);
+	  if (v > h->max)
+	    v = h->max;
+	  *out[j++] = v / 1000.0;
+	}
+    }
+  return true;
 }
 
 void
-perf_output_results (void)
+perf_print (const int msglevel)
 {
   int i;
-  msg (M_INFO, "LATENCY PROFILE (mean and max are in milliseconds)");
+  msg (msglevel, "HEADER,PERF,Stage,Count,Mean,P50,P90,P99,P99.9,Max");
   for (i = 0; i < PERF_N; ++i)
     {
-      struct perf *p = &perf_set.perf[i];
-      if (p->count > 0.0)
-	{
-	  const double mean = p->sum / p->count;
-	  msg (M_INFO, "%s n=%.0f mean=%.3f max=%.3f", metric_names[i], p->count, mean*1000.0, p->max*1000.0);
-	}
+      struct perf_summary s;
+      if (perf_get_summary (i, &s))
+	msg (msglevel, "PERF,%s," counter_format ",%.1f,%.1f,%.1f,%.1f,%.1f,%.1f",
+	     metric_names[i], s.count, s.mean, s.p50, s.p90, s.p99, s.p999, s.max);
     }
 }
 
-static void
-perf_print_state (int lev)
+void
+perf_output_results (void)
 {
-  struct gc_arena gc = gc_new ();
   int i;
-  msg (lev, "PERF STATE");
-  msg (lev, "Stack:");
-  for (i = 0; i < perf_set.stack_len; ++i)
+
+  if (!perf_set.hist)
+    return;
+
+  msg (M_INFO, "LATENCY PROFILE (times are in microseconds)");
+  for (i = 0; i < PERF_N; ++i)
     {
-      const int j = perf_set.stack[i];
-      const struct perf *p = &perf_set.perf[j];
-      msg (lev, "[%d] %s state=%d start=%s sofar=%f sum=%f max=%f count=%f",
-	   i,
-	   metric_names[j],
-	   p->state,
-	   tv_string (&p->start, &gc),
-	   p->sofar,
-	   p->sum,
-	   p->max,
-	   p->count);
+      struct perf_summary s;
+      if (perf_get_summary (i, &s))
+	msg (M_INFO, "%s n=" counter_format " mean=%.1f p50=%.1f p99=%.1f p99.9=%.1f max=%.1f",
+	     metric_names[i], s.count, s.mean, s.p50, s.p99, s.p999, s.max);
     }
-  gc_free (&gc);
 }
 
 #else
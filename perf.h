@@ -31,7 +31,7 @@
 #ifndef PERF_H
 #define PERF_H
 
-/*#define ENABLE_PERFORMANCE_METRICS*/
+#define ENABLE_PERFORMANCE_METRICS
 
 /*
  * Metrics
@@ -61,14 +61,67 @@
 #ifdef ENABLE_PERFORMANCE_METRICS
 
 #include "basic.h"
+#include "common.h"
 
 /*
  * Stack size
  */
 #define STACK_N               64
 
-void perf_push (int type);
-void perf_pop (void);
+/*
+ * Each stage keeps a log-linear latency histogram: values
+ * below 2^PERF_HIST_SUB_BITS ns get a bucket each, above
+ * that every power of two is split into 2^PERF_HIST_SUB_BITS
+ * linear buckets, for about 6% relative precision.  Values
+ * are clamped at 2^PERF_HIST_MAX_BITS ns (about 18 minutes).
+ */
+#define PERF_HIST_SUB_BITS    4
+#define PERF_HIST_MAX_BITS    40
+
+/*
+ * Measurement is off until perf_enable is called, and
+ * perf_push/perf_pop then cost a flag test.
+ */
+extern bool perf_enabled;
+
+void perf_push_dowork (int type);
+void perf_pop_dowork (void);
+
+static inline void
+perf_push (int type)
+{
+  if (perf_enabled)
+    perf_push_dowork (type);
+}
+
+static inline void
+perf_pop (void)
+{
+  if (perf_enabled)
+    perf_pop_dowork ();
+}
+
+void perf_enable (const bool enable);
+void perf_reset (void);
+
+/* latency summary of one stage, in microseconds */
+struct perf_summary
+{
+  counter_type count;
+  double mean;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  double max;
+};
+
+const char *perf_name (const int type);
+bool perf_get_summary (const int type, struct perf_summary *s);
+
+/* one line per stage, for the management interface */
+void perf_print (const int msglevel);
+
 void perf_output_results (void);
 
 #else
@@ -34,6 +34,7 @@
 #include "buffer.h"
 #include "error.h"
 #include "common.h"
+#include "otime.h"
 #include "reliable.h"
 
 #include "memdbg.h"
@@ -125,7 +126,7 @@ reliable_ack_read_packet_id (struct buffer *buf, packet_id_type *pid)
 bool
 reliable_ack_acknowledge_packet_id (struct reliable_ack *ack, packet_id_type pid)
 {
-  if (!reliable_ack_packet_id_present (ack, pid) && ack->len < RELIABLE_ACK_SIZE)
+  if (!reliable_ack_packet_id_present (ack, pid) && ack->len < RELIABLE_CAPACITY)
     {
       ack->packet_id[ack->len++] = pid;
       dmsg (D_REL_DEBUG, "ACK acknowledge ID " packet_id_format " (ack->len=%d)",
@@ -277,7 +278,9 @@ reliable_init (struct reliable *rel, int buf_size, int offset, int array_size, b
   ASSERT (array_size > 0 && array_size <= RELIABLE_CAPACITY);
   rel->hold = hold;
   rel->size = array_size;
+  rel->buf_size = buf_size;
   rel->offset = offset;
+  ALLOC_ARRAY_CLEAR (rel->array, struct reliable_entry, rel->size);
   for (i = 0; i < rel->size; ++i)
     {
       struct reliable_entry *e = &rel->array[i];
@@ -295,6 +298,74 @@ reliable_free (struct reliable *rel)
       struct reliable_entry *e = &rel->array[i];
       free_buf (&e->buf);
     }
+  free (rel->array);
+  rel->array = NULL;
+}
+
+void
+reliable_trim (struct reliable *rel)
+{
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    {
+      struct reliable_entry *e = &rel->array[i];
+      if (!e->active)
+	free_buf (&e->buf);
+    }
+}
+
+size_t
+reliable_memory (const struct reliable *rel)
+{
+  size_t ret = sizeof (*rel) + rel->size * sizeof (struct reliable_entry);
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    ret += rel->array[i].buf.capacity;
+  return ret;
+}
+
+/*
+ * Update the RTT estimator with the time it took for entry e
+ * to be acknowledged (RFC 6298).
+ */
+static void
+reliable_rtt_sample (struct reliable *rel, const struct reliable_entry *e)
+{
+  struct timeval tv;
+  int rtt;
+
+  if (e->n_sent != 1 || openvpn_gettimeofday (&tv, NULL))
+    return;
+
+  rtt = tv_subtract (&tv, &e->sent, RELIABLE_RTO_MAX) / 1000;
+  if (rtt <= 0)
+    rtt = 1;
+
+  if (!rel->srtt)
+    {
+      rel->srtt = rtt;
+      rel->rttvar = rtt / 2;
+    }
+  else
+    {
+      rel->rttvar = (3 * rel->rttvar + abs (rel->srtt - rtt)) / 4;
+      rel->srtt = (7 * rel->srtt + rtt) / 8;
+    }
+
+  dmsg (D_REL_DEBUG, "ACK rtt=%dms srtt=%dms rttvar=%dms rto=%ds",
+	rtt, rel->srtt, rel->rttvar, (int)reliable_rto (rel));
+}
+
+/* current retransmit timeout in seconds */
+interval_t
+reliable_rto (const struct reliable *rel)
+{
+  if (rel->srtt)
+    {
+      const int rto_ms = rel->srtt + 4 * rel->rttvar;
+      return constrain_int ((rto_ms + 999) / 1000, RELIABLE_RTO_MIN, RELIABLE_RTO_MAX);
+    }
+  return rel->initial_timeout;
 }
 
 /* no active buffers? */
@@ -311,7 +382,15 @@ reliable_empty (const struct reliable *rel)
   return true;
 }
 
-/* del acknowledged items from send buf */
+/*
+ * Del acknowledged items from send buf.  ACKs list individual
+ * packet IDs, so a lower packet ID which is still outstanding
+ * after several higher ones were acknowledged was most likely
+ * lost, and is scheduled for immediate retransmit.  Only the
+ * first ACK for a packet still in the send buf counts towards
+ * that: ACKs repeated by the peer, or for packets already
+ * deleted, say nothing new about what was lost.
+ */
 void
 reliable_send_purge (struct reliable *rel, struct reliable_ack *ack)
 {
@@ -319,28 +398,48 @@ reliable_send_purge (struct reliable *rel, struct reliable_ack *ack)
   for (i = 0; i < ack->len; ++i)
     {
       packet_id_type pid = ack->packet_id[i];
+      struct reliable_entry *acked = NULL;
       for (j = 0; j < rel->size; ++j)
 	{
 	  struct reliable_entry *e = &rel->array[j];
 	  if (e->active && e->packet_id == pid)
 	    {
-	      dmsg (D_REL_DEBUG,
-		   "ACK received for pid " packet_id_format ", deleting from send buffer",
-		   (packet_id_print_type)pid);
-#if 0
-	      /* DEBUGGING -- how close were we timing out on ACK failure and resending? */
-	      {
-		if (e->next_try)
-		  {
-		    const interval_t wake = e->next_try - now;
-		    msg (M_INFO, "ACK " packet_id_format ", wake=%d", pid, wake);
-		  }
-	      }
-#endif
-	      e->active = false;
+	      acked = e;
 	      break;
 	    }
 	}
+      if (!acked)
+	continue;
+
+      for (j = 0; j < rel->size; ++j)
+	{
+	  struct reliable_entry *e = &rel->array[j];
+	  if (e->active && e != acked && reliable_pid_min (e->packet_id, pid))
+	    {
+	      if (++e->n_acked_after == RELIABLE_FAST_RETRANSMIT)
+		{
+		  dmsg (D_REL_DEBUG, "ACK fast retransmit pid " packet_id_format,
+			(packet_id_print_type)e->packet_id);
+		  e->next_try = now;
+		}
+	    }
+	}
+
+      dmsg (D_REL_DEBUG,
+	   "ACK received for pid " packet_id_format ", deleting from send buffer",
+	   (packet_id_print_type)pid);
+      reliable_rtt_sample (rel, acked);
+#if 0
+      /* DEBUGGING -- how close were we timing out on ACK failure and resending? */
+      {
+	if (acked->next_try)
+	  {
+	    const interval_t wake = acked->next_try - now;
+	    msg (M_INFO, "ACK " packet_id_format ", wake=%d", pid, wake);
+	  }
+      }
+#endif
+      acked->active = false;
     }
 }
 
@@ -431,6 +530,8 @@ reliable_get_buf (struct reliable *rel)
       struct reliable_entry *e = &rel->array[i];
       if (!e->active)
 	{
+	  if (!buf_defined (&e->buf))
+	    e->buf = alloc_buf (rel->buf_size);	/* released by reliable_trim */
 	  ASSERT (buf_init (&e->buf, rel->offset));
 	  return &e->buf;
 	}
@@ -474,6 +575,25 @@ reliable_get_buf_output_sequenced (struct reliable *rel)
   return ret;
 }
 
+/*
+ * Get the most recently activated outgoing buffer if it
+ * carries opcode and has not been sent yet, so that more
+ * payload can be appended to it.
+ */
+struct buffer *
+reliable_get_buf_output_unsent (struct reliable *rel, int opcode)
+{
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    {
+      struct reliable_entry *e = &rel->array[i];
+      if (e->active && !e->n_sent && e->opcode == opcode
+	  && e->packet_id == rel->packet_id - 1)
+	return &e->buf;
+    }
+  return NULL;
+}
+
 /* get active buffer for next sequentially increasing key ID */
 struct buffer *
 reliable_get_buf_sequenced (struct reliable *rel)
@@ -565,6 +685,9 @@ reliable_send (struct reliable *rel, int *opcode)
       /* constant timeout, no backoff */
       best->next_try = local_now + best->timeout;
 #endif
+      if (!best->n_sent++)
+	openvpn_gettimeofday (&best->sent, NULL);
+      best->n_acked_after = 0;
       *opcode = best->opcode;
       dmsg (D_REL_DEBUG, "ACK reliable_send ID " packet_id_format " (size=%d to=%d)",
 	   (packet_id_print_type)best->packet_id, best->buf.len,
@@ -587,7 +710,7 @@ reliable_schedule_now (struct reliable *rel)
       if (e->active)
 	{
 	  e->next_try = now;
-	  e->timeout = rel->initial_timeout;
+	  e->timeout = reliable_rto (rel);
 	}
     }
 }
@@ -681,7 +804,9 @@ reliable_mark_active_outgoing (struct reliable *rel, struct buffer *buf, int opc
 	  e->active = true;
 	  e->opcode = opcode;
 	  e->next_try = 0;
-	  e->timeout = rel->initial_timeout;
+	  e->timeout = reliable_rto (rel);
+	  e->n_sent = 0;
+	  e->n_acked_after = 0;
 	  dmsg (D_REL_DEBUG, "ACK mark active outgoing ID " packet_id_format, (packet_id_print_type)e->packet_id);
 	  return;
 	}
@@ -40,12 +40,16 @@
 
 #define EXPONENTIAL_BACKOFF
 
+/* max number of packet IDs in one ACK record on the wire */
 #define RELIABLE_ACK_SIZE 8
 
+/* max window size of a struct reliable */
+#define RELIABLE_CAPACITY 32
+
 struct reliable_ack
 {
   int len;
-  packet_id_type packet_id[RELIABLE_ACK_SIZE];
+  packet_id_type packet_id[RELIABLE_CAPACITY];
 };
 
 /* no active buffers? */
@@ -78,7 +82,19 @@ void reliable_ack_adjust_frame_parameters (struct frame* frame, int max);
 
 void reliable_ack_debug_print (const struct reliable_ack *ack, char *desc);
 
-#define RELIABLE_CAPACITY 8
+/*
+ * Retransmit timeout bounds (seconds) once the RTT estimator
+ * has a sample.  Before that, initial_timeout (--tls-timeout)
+ * is used.
+ */
+#define RELIABLE_RTO_MIN 1
+#define RELIABLE_RTO_MAX 30
+
+/*
+ * Retransmit an unacknowledged packet immediately once this
+ * many higher packet IDs have been selectively acknowledged.
+ */
+#define RELIABLE_FAST_RETRANSMIT 3
 
 struct reliable_entry
 {
@@ -87,32 +103,51 @@ struct reliable_entry
   time_t next_try;
   packet_id_type packet_id;
   int opcode;
+  int n_sent;		  /* number of times sent, for Karn's algorithm */
+  int n_acked_after;	  /* higher packet IDs acknowledged while we were pending */
+  struct timeval sent;	  /* time of first transmission */
   struct buffer buf;
 };
 
 struct reliable
 {
   int size;
+  int buf_size;
   interval_t initial_timeout;
   packet_id_type packet_id;
   int offset;
   bool hold; /* don't xmit until reliable_schedule_now is called */
-  struct reliable_entry array[RELIABLE_CAPACITY];
+
+  /* round trip time estimator, in milliseconds (RFC 6298) */
+  int srtt;		  /* smoothed RTT, 0 if no sample yet */
+  int rttvar;		  /* RTT variation */
+
+  struct reliable_entry *array;
 };
 
 void reliable_debug_print (const struct reliable *rel, char *desc);
 
-/* set sending timeout (after this time we send again until ACK) */
+/* set initial sending timeout (after this time we send again until ACK),
+   used until the RTT estimator has a sample */
 static inline void
 reliable_set_timeout (struct reliable *rel, interval_t timeout)
 {
   rel->initial_timeout = timeout;
 }
 
+/* current retransmit timeout in seconds */
+interval_t reliable_rto (const struct reliable *rel);
+
 void reliable_init (struct reliable *rel, int buf_size, int offset, int array_size, bool hold);
 
 void reliable_free (struct reliable *rel);
 
+/* free the buffers of inactive entries, they are reallocated on demand */
+void reliable_trim (struct reliable *rel);
+
+/* heap bytes held by rel */
+size_t reliable_memory (const struct reliable *rel);
+
 /* no active buffers? */
 bool reliable_empty (const struct reliable *rel);
 
@@ -137,6 +172,9 @@ struct buffer *reliable_get_buf (struct reliable *rel);
 /* grab a free buffer, fail if buffer clogged by unacknowledged low packet IDs */
 struct buffer *reliable_get_buf_output_sequenced (struct reliable *rel);
 
+/* get the last outgoing buffer with this opcode if it hasn't been sent yet */
+struct buffer *reliable_get_buf_output_unsent (struct reliable *rel, int opcode);
+
 /* get active buffer for next sequentially increasing key ID */
 struct buffer *reliable_get_buf_sequenced (struct reliable *rel);
 
@@ -0,0 +1,319 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#ifdef ENABLE_BUFFER_RING
+
+#include "buffer.h"
+#include "error.h"
+#include "misc.h"
+#include "ring.h"
+
+#include "memdbg.h"
+
+#ifdef RING_TEST
+#include <sched.h>
+/* widen the window between loading head and publishing it in head_cache */
+static volatile bool ring_test_preempt; /* GLOBAL */
+#define RING_TEST_PREEMPT() do { if (ring_test_preempt && !(random () & 3)) sched_yield (); } while (false)
+#else
+#define RING_TEST_PREEMPT()
+#endif
+
+struct buffer_ring *
+buffer_ring_init (unsigned int size, unsigned int flags)
+{
+  struct buffer_ring *ret;
+  ALLOC_OBJ_CLEAR (ret, struct buffer_ring);
+  ret->capacity = adjust_power_of_2 (size);
+  ret->mask = ret->capacity - 1;
+  ret->flags = flags;
+  ALLOC_ARRAY_CLEAR (ret->slots, struct buffer_ring_slot, ret->capacity);
+  return ret;
+}
+
+void
+buffer_ring_free (struct buffer_ring *r)
+{
+  if (r)
+    {
+      free (r->slots);
+      free (r);
+    }
+}
+
+/*
+ * Move head_cache forward to h.  With RING_MPSC several producers
+ * refresh it concurrently, and one that was preempted after loading
+ * head must not store its older value over a newer one.
+ */
+static inline void
+buffer_ring_advance_head_cache (struct buffer_ring *r, const unsigned int h)
+{
+  if (r->flags & RING_MPSC)
+    {
+      unsigned int old = r->head_cache;
+      while ((int) (h - old) > 0 && !__sync_bool_compare_and_swap (&r->head_cache, old, h))
+	old = r->head_cache;
+    }
+  else
+    r->head_cache = h;
+}
+
+int
+buffer_ring_enqueue_batch (struct buffer_ring *r, const struct buffer *bufs, int n)
+{
+  unsigned int pos;
+  int k;
+  int i;
+
+  if (n <= 0)
+    return 0;
+
+  /* reserve k contiguous positions starting at pos */
+  do
+    {
+      /*
+       * Load head_cache before tail so that pos - head_cache can't
+       * go negative.  k is signed: with a stale pos it may exceed
+       * capacity, but then the CAS below fails and we retry.
+       */
+      const unsigned int hc = r->head_cache;
+      __sync_synchronize ();
+      pos = r->tail;
+      k = (int) r->capacity - (int) (pos - hc);
+      if (k < n)
+	{
+	  const unsigned int h = r->head;
+	  RING_TEST_PREEMPT ();
+	  /* consumer is done with slots below head before we overwrite them */
+	  __sync_synchronize ();
+	  buffer_ring_advance_head_cache (r, h);
+	  k = (int) r->capacity - (int) (pos - h);
+	}
+      if (k > n)
+	k = n;
+      if (k <= 0)
+	return 0;
+      if (!(r->flags & RING_MPSC))
+	{
+	  r->tail = pos + k;
+	  break;
+	}
+    }
+  while (!__sync_bool_compare_and_swap (&r->tail, pos, pos + k));
+
+  for (i = 0; i < k; ++i)
+    r->slots[(pos + i) & r->mask].buf = bufs[i];
+
+  /* publish the descriptors before marking them ready */
+  __sync_synchronize ();
+
+  for (i = 0; i < k; ++i)
+    r->slots[(pos + i) & r->mask].seq = pos + i + 1;
+
+  return k;
+}
+
+int
+buffer_ring_dequeue_batch (struct buffer_ring *r, struct buffer *bufs, int n)
+{
+  const unsigned int pos = r->head;
+  int k = 0;
+  int i;
+
+  while (k < n && r->slots[(pos + k) & r->mask].seq == pos + k + 1)
+    ++k;
+
+  if (!k)
+    return 0;
+
+  /* don't read a descriptor before its ready mark */
+  __sync_synchronize ();
+
+  for (i = 0; i < k; ++i)
+    bufs[i] = r->slots[(pos + i) & r->mask].buf;
+
+  /* finish reading the slots before handing them back to producers */
+  __sync_synchronize ();
+
+  r->head = pos + k;
+  return k;
+}
+
+#ifdef RING_TEST
+
+#include <pthread.h>
+
+/*
+ * Stress and throughput test.  Producer threads push
+ * descriptors carrying (producer id, sequence number)
+ * in offset/len, using random batch sizes; the consumer
+ * checks that nothing is lost, duplicated or reordered
+ * within a producer.  The preempt runs use a small ring
+ * and make producers yield between loading head and
+ * publishing it, so that stale head_cache refreshes
+ * actually race with newer ones.
+ */
+
+#define RING_TEST_SIZE      1024
+#define RING_TEST_SMALL     16
+#define RING_TEST_STALL_SEC 10
+#define RING_TEST_MAX_PROD  4
+#define RING_TEST_N         2000000
+#define RING_TEST_BATCH     32
+
+struct ring_test_producer
+{
+  struct buffer_ring *ring;
+  int id;
+  int batch;			/* 0 for random batch sizes */
+  pthread_t thread;
+};
+
+static void *
+ring_test_producer (void *arg)
+{
+  struct ring_test_producer *p = (struct ring_test_producer *) arg;
+  struct buffer bufs[RING_TEST_BATCH];
+  int seq = 0;
+
+  while (seq < RING_TEST_N)
+    {
+      int n = p->batch ? p->batch : (int)(random () % RING_TEST_BATCH) + 1;
+      int i, done = 0;
+
+      if (n > RING_TEST_N - seq)
+	n = RING_TEST_N - seq;
+      for (i = 0; i < n; ++i)
+	{
+	  CLEAR (bufs[i]);
+	  bufs[i].offset = p->id;
+	  bufs[i].len = seq + i;
+	}
+      while (done < n)
+	{
+	  const int k = buffer_ring_enqueue_batch (p->ring, bufs + done, n - done);
+	  if (!k)
+	    sched_yield ();
+	  done += k;
+	}
+      seq += n;
+    }
+  return NULL;
+}
+
+static void
+ring_test_run (const char *name, const unsigned int flags, const int n_prod, const int batch,
+	       const unsigned int size, const bool preempt)
+{
+  struct buffer_ring *ring = buffer_ring_init (size, flags);
+  struct ring_test_producer prod[RING_TEST_MAX_PROD];
+  int next[RING_TEST_MAX_PROD];
+  struct buffer bufs[RING_TEST_BATCH];
+  const int total = n_prod * RING_TEST_N;
+  struct timeval start, end, idle_since;
+  unsigned int idle = 0;
+  int received = 0;
+  int i;
+
+  ASSERT (n_prod <= RING_TEST_MAX_PROD);
+
+  ring_test_preempt = preempt;
+  openvpn_gettimeofday (&start, NULL);
+  for (i = 0; i < n_prod; ++i)
+    {
+      next[i] = 0;
+      prod[i].ring = ring;
+      prod[i].id = i;
+      prod[i].batch = batch;
+      ASSERT (!pthread_create (&prod[i].thread, NULL, ring_test_producer, &prod[i]));
+    }
+
+  while (received < total)
+    {
+      const int n = buffer_ring_dequeue_batch (ring, bufs, batch ? batch : RING_TEST_BATCH);
+      if (!n)
+	{
+	  /* a lost slot leaves the consumer waiting for a ready mark that never comes */
+	  if (++idle == 1)
+	    openvpn_gettimeofday (&idle_since, NULL);
+	  else if (!(idle & 0xFFFF))
+	    {
+	      openvpn_gettimeofday (&end, NULL);
+	      if (tv_subtract (&end, &idle_since, 600) > RING_TEST_STALL_SEC * 1000000)
+		msg (M_FATAL, "RING_TEST %s: stalled at %d of %d buffers", name, received, total);
+	    }
+	  sched_yield ();
+	}
+      else
+	idle = 0;
+      for (i = 0; i < n; ++i)
+	{
+	  const int id = bufs[i].offset;
+	  ASSERT (id >= 0 && id < n_prod);
+	  if (bufs[i].len != next[id])
+	    msg (M_FATAL, "RING_TEST %s: producer %d sent %d, expected %d",
+		 name, id, bufs[i].len, next[id]);
+	  ++next[id];
+	}
+      received += n;
+    }
+
+  for (i = 0; i < n_prod; ++i)
+    pthread_join (prod[i].thread, NULL);
+  openvpn_gettimeofday (&end, NULL);
+
+  ASSERT (buffer_ring_len (ring) == 0);
+  {
+    const int usec = tv_subtract (&end, &start, 600);
+    printf ("%s producers=%d batch=%d size=%u preempt=%d buffers=%d usec=%d ns_per_buffer=%.1f mbuf_per_sec=%.2f\n",
+	    name, n_prod, batch, size, preempt, total, usec,
+	    usec * 1000.0 / total,
+	    usec ? (double) total / usec : 0.0);
+  }
+  buffer_ring_free (ring);
+}
+
+void
+ring_test (void)
+{
+  ring_test_run ("SPSC", 0, 1, 1, RING_TEST_SIZE, false);
+  ring_test_run ("SPSC", 0, 1, RING_TEST_BATCH, RING_TEST_SIZE, false);
+  ring_test_run ("SPSC", 0, 1, 0, RING_TEST_SIZE, false);
+  ring_test_run ("SPSC", 0, 1, 0, RING_TEST_SMALL, true);
+  ring_test_run ("MPSC", RING_MPSC, 2, 1, RING_TEST_SIZE, false);
+  ring_test_run ("MPSC", RING_MPSC, RING_TEST_MAX_PROD, 1, RING_TEST_SIZE, false);
+  ring_test_run ("MPSC", RING_MPSC, RING_TEST_MAX_PROD, RING_TEST_BATCH, RING_TEST_SIZE, false);
+  ring_test_run ("MPSC", RING_MPSC, RING_TEST_MAX_PROD, 0, RING_TEST_SIZE, false);
+  ring_test_run ("MPSC", RING_MPSC, RING_TEST_MAX_PROD, 1, RING_TEST_SMALL, true);
+  ring_test_run ("MPSC", RING_MPSC, RING_TEST_MAX_PROD, 0, RING_TEST_SMALL, true);
+}
+
+#endif /* RING_TEST */
+
+#else
+static void dummy(void) {}
+#endif /* ENABLE_BUFFER_RING */
@@ -0,0 +1,125 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RING_H
+#define RING_H
+
+/*
+ * Bounded lock-free ring of struct buffer descriptors,
+ * for handing packets from one thread to another.
+ *
+ * A ring has exactly one consumer thread.  By default it
+ * also has exactly one producer thread (SPSC); with
+ * RING_MPSC any number of threads may enqueue concurrently.
+ *
+ * Only the descriptor is copied -- whoever holds a
+ * struct buffer after dequeue owns the memory it points to.
+ */
+
+#ifdef ENABLE_BUFFER_RING
+
+/* define this to enable special ring test mode */
+/*#define RING_TEST*/
+
+#include "basic.h"
+#include "buffer.h"
+#include "thread.h"
+
+#define RING_MPSC (1<<0)
+
+struct buffer_ring_slot
+{
+  volatile unsigned int seq;	/* == position+1 when buf is ready for the consumer */
+  struct buffer buf;
+};
+
+/*
+ * The consumer and producer indices live in separate
+ * cache lines.  Producers keep a cached copy of the
+ * consumer index and only reload it when the ring looks
+ * full; the cached copy only ever moves forward.  The
+ * consumer never reads the producer index, it polls the
+ * per-slot sequence numbers instead.
+ */
+struct buffer_ring
+{
+  /* consumer side */
+  volatile unsigned int head;
+  uint8_t pad0[CACHE_LINE_SIZE - sizeof (unsigned int)];
+
+  /* producer side */
+  volatile unsigned int tail;
+  volatile unsigned int head_cache;
+  uint8_t pad1[CACHE_LINE_SIZE - 2 * sizeof (unsigned int)];
+
+  /* read-only after buffer_ring_init */
+  unsigned int capacity;
+  unsigned int mask;
+  unsigned int flags;
+  struct buffer_ring_slot *slots;
+};
+
+struct buffer_ring *buffer_ring_init (unsigned int size, unsigned int flags);
+void buffer_ring_free (struct buffer_ring *r);
+
+/*
+ * Enqueue up to n buffers, in order.  Returns the number
+ * actually enqueued, which is less than n if the ring
+ * fills up.  With RING_MPSC the buffers of one batch are
+ * contiguous in the ring.
+ */
+int buffer_ring_enqueue_batch (struct buffer_ring *r, const struct buffer *bufs, int n);
+
+/*
+ * Dequeue up to n buffers into bufs, in order.  Returns
+ * the number dequeued, 0 if the ring is empty.  Consumer
+ * thread only.
+ */
+int buffer_ring_dequeue_batch (struct buffer_ring *r, struct buffer *bufs, int n);
+
+static inline bool
+buffer_ring_enqueue (struct buffer_ring *r, const struct buffer *buf)
+{
+  return buffer_ring_enqueue_batch (r, buf, 1) == 1;
+}
+
+static inline bool
+buffer_ring_dequeue (struct buffer_ring *r, struct buffer *buf)
+{
+  return buffer_ring_dequeue_batch (r, buf, 1) == 1;
+}
+
+/* approximate number of queued buffers, exact when called by the consumer of an idle ring */
+static inline unsigned int
+buffer_ring_len (const struct buffer_ring *r)
+{
+  return r->tail - r->head;
+}
+
+#ifdef RING_TEST
+void ring_test (void);
+#endif
+
+#endif /* ENABLE_BUFFER_RING */
+#endif /* RING_H */
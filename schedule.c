@@ -312,6 +312,8 @@ schedule_add_modify (struct schedule *s, struct schedule_entry *e)
   /* already in tree, remove */
   if (IN_TREE (e))
     schedule_remove_node (s, e);
+  else
+    ++s->size;
 
   /* set random priority */
   schedule_set_pri (e);
@@ -376,6 +378,8 @@ void
 schedule_remove_entry (struct schedule *s, struct schedule_entry *e)
 {
   s->earliest_wakeup = NULL; /* invalidate cache */
+  if (IN_TREE (e))
+    --s->size;
   schedule_remove_node (s, e);
 }
 
@@ -57,6 +57,7 @@ struct schedule
 {
   struct schedule_entry *earliest_wakeup; /* cached earliest wakeup */
   struct schedule_entry *root;            /* the root of the treap (btree) */
+  int size;                               /* number of entries in the tree */
 };
 
 /* Public functions */
@@ -1000,15 +1000,18 @@ socket_frame_init (const struct frame *frame, struct link_socket *sock)
 		       sock->sockflags,
 		       sock->info.proto);
 #else
-      alloc_buf_sock_tun (&sock->stream_buf_data,
-			  frame,
-			  false,
-			  FRAME_HEADROOM_MARKER_READ_STREAM);
+      const bool shared = (sock->mode == LS_MODE_TCP_ACCEPT_FROM);
+      sock->stream_buf_data = alloc_buf (BUF_SIZE (frame) + (shared ? 0 : STREAM_BUF_READ_SIZE));
+      ASSERT (buf_init (&sock->stream_buf_data,
+			FRAME_HEADROOM_ADJ (frame, FRAME_HEADROOM_MARKER_READ_STREAM)));
+      sock->stream_buf_data.len = MAX_RW_SIZE_LINK (frame);
 
       stream_buf_init (&sock->stream_buf,
 		       &sock->stream_buf_data,
 		       sock->sockflags,
 		       sock->info.proto);
+      if (shared)
+	stream_buf_share (&sock->stream_buf, BUF_SIZE (frame) + STREAM_BUF_READ_SIZE);
 #endif
     }
 }
@@ -1777,10 +1780,20 @@ socket_stat (const struct link_socket *s, unsigned int rwflags, struct gc_arena
  * stream connection.
  */
 
+/*
+ * The read area shared by the TCP server instances of this
+ * process, and the instance whose unread stream data is in it.
+ */
+static struct buffer stream_buf_shared; /* GLOBAL */
+static struct stream_buf *stream_buf_shared_owner; /* GLOBAL */
+static int stream_buf_shared_refcount; /* GLOBAL */
+
 static inline void
 stream_buf_reset (struct stream_buf *sb)
 {
   dmsg (D_STREAM_DEBUG, "STREAM: RESET");
+  if (stream_buf_shared_owner == sb)
+    stream_buf_shared_owner = NULL;
   sb->residual_fully_formed = false;
   sb->buf = sb->buf_init;
   buf_reset (&sb->next);
@@ -1808,28 +1821,90 @@ stream_buf_init (struct stream_buf *sb,
   dmsg (D_STREAM_DEBUG, "STREAM: INIT maxlen=%d", sb->maxlen);
 }
 
+/*
+ * Let sb recv() into the read area shared by the process,
+ * which is allocated with the first user.  size covers the
+ * headroom of buf_init as well.
+ */
+void
+stream_buf_share (struct stream_buf *sb, const int size)
+{
+  if (!stream_buf_shared_refcount)
+    {
+      stream_buf_shared = alloc_buf (size);
+      ASSERT (buf_init (&stream_buf_shared, sb->buf_init.offset));
+    }
+
+  /* all instances of a server normally use the same frame */
+  if (stream_buf_shared.offset == sb->buf_init.offset
+      && stream_buf_shared.capacity >= size)
+    {
+      sb->shared = true;
+      ++stream_buf_shared_refcount;
+    }
+  else if (!stream_buf_shared_refcount)
+    free_buf (&stream_buf_shared);
+}
+
+/*
+ * Move sb's unread data into the shared read area.  The data
+ * of the previous owner goes back to its own buffer first, or
+ * if that is more than the buffer holds, sb keeps reading into
+ * its own buffer this time.
+ */
+static void
+stream_buf_claim_shared (struct stream_buf *sb)
+{
+  struct stream_buf *owner = stream_buf_shared_owner;
+  struct buffer buf;
+
+  if (owner)
+    {
+      buf = owner->buf_init;
+      if (!buf_copy (&buf, &owner->buf))
+	return;
+      dmsg (D_STREAM_DEBUG, "STREAM: RETURN %d bytes from the shared read area", buf.len);
+      owner->buf = buf;
+    }
+
+  buf = stream_buf_shared;
+  ASSERT (buf_copy (&buf, &sb->buf));
+  sb->buf = buf;
+  stream_buf_shared_owner = sb;
+}
+
 static inline void
 stream_buf_set_next (struct stream_buf *sb)
 {
-  /* set up 'next' for next i/o read */
+  const int need = (sb->len >= 0 ? sb->len : (int) sizeof (packet_size_type)) - sb->buf.len;
+
+  if (sb->shared && stream_buf_shared_owner != sb)
+    stream_buf_claim_shared (sb);
+
+  /*
+   * buf only holds a partial packet here.  Once less than a
+   * full packet of space is left behind it, move it back to
+   * the start of its area (both areas use the same offset).
+   */
+  if (!sb->buf.len)
+    sb->buf.offset = sb->buf_init.offset;
+  else if (buf_forward_capacity (&sb->buf) < sb->maxlen + (int) sizeof (packet_size_type)
+	   && sb->buf.offset > sb->buf_init.offset)
+    {
+      dmsg (D_STREAM_DEBUG, "STREAM: MOVE %d bytes from offset %d", sb->buf.len, sb->buf.offset);
+      memmove (sb->buf.data + sb->buf_init.offset, BPTR (&sb->buf), sb->buf.len);
+      sb->buf.offset = sb->buf_init.offset;
+    }
+
+  /* set up 'next' to read as much of the stream as will fit */
   sb->next = sb->buf;
   sb->next.offset = sb->buf.offset + sb->buf.len;
-  sb->next.len = (sb->len >= 0 ? sb->len : sb->maxlen) - sb->buf.len;
+  sb->next.len = buf_forward_capacity (&sb->buf);
   dmsg (D_STREAM_DEBUG, "STREAM: SET NEXT, buf=[%d,%d] next=[%d,%d] len=%d maxlen=%d",
        sb->buf.offset, sb->buf.len,
        sb->next.offset, sb->next.len,
        sb->len, sb->maxlen);
-  ASSERT (sb->next.len > 0);
-  ASSERT (buf_safe (&sb->buf, sb->next.len));
-}
-
-static inline void
-stream_buf_get_final (struct stream_buf *sb, struct buffer *buf)
-{
-  dmsg (D_STREAM_DEBUG, "STREAM: GET FINAL len=%d",
-       buf_defined (&sb->buf) ? sb->buf.len : -1);
-  ASSERT (buf_defined (&sb->buf));
-  *buf = sb->buf;
+  ASSERT (sb->next.len >= need && sb->next.len > 0);
 }
 
 static inline void
@@ -1841,22 +1916,56 @@ stream_buf_get_next (struct stream_buf *sb, struct buffer *buf)
   *buf = sb->next;
 }
 
+/*
+ * Hand out the complete packet at the head of buf, in place,
+ * and check whether the data behind it already holds the
+ * next one.
+ *
+ * The packet is handed out at the offset of buf_init, as if it
+ * had been read on its own, since buffer_turnover() copies
+ * packets that stay in place with their offset into a buffer
+ * of one packet.
+ */
+static inline void
+stream_buf_get_final (struct stream_buf *sb, struct buffer *buf)
+{
+  const int skip = sb->buf.offset - sb->buf_init.offset;
+
+  dmsg (D_STREAM_DEBUG, "STREAM: GET FINAL len=%d", sb->len);
+  ASSERT (buf_defined (&sb->buf) && sb->len > 0 && sb->buf.len >= sb->len);
+  ASSERT (skip >= 0);
+  *buf = sb->buf;
+  buf->data += skip;
+  buf->capacity -= skip;
+  buf->offset -= skip;
+  buf->len = sb->len;
+  ASSERT (buf_advance (&sb->buf, sb->len));
+  sb->len = -1;
+  sb->residual_fully_formed = stream_buf_added (sb, 0);
+}
+
 bool
 stream_buf_read_setup_dowork (struct link_socket* sock)
 {
-  if (sock->stream_buf.residual.len && !sock->stream_buf.residual_fully_formed)
+  struct stream_buf *sb = &sock->stream_buf;
+
+  if (sb->residual.len && !sb->residual_fully_formed)
     {
-      ASSERT (buf_copy (&sock->stream_buf.buf, &sock->stream_buf.residual));
-      ASSERT (buf_init (&sock->stream_buf.residual, 0));
-      sock->stream_buf.residual_fully_formed = stream_buf_added (&sock->stream_buf, 0);
+      stream_buf_set_next (sb);
+      ASSERT (buf_copy (&sb->buf, &sb->residual));
+      ASSERT (buf_init (&sb->residual, 0));
+      sb->residual_fully_formed = stream_buf_added (sb, 0);
       dmsg (D_STREAM_DEBUG, "STREAM: RESIDUAL FULLY FORMED [%s], len=%d",
-	   sock->stream_buf.residual_fully_formed ? "YES" : "NO",
-	   sock->stream_buf.residual.len);
+	   sb->residual_fully_formed ? "YES" : "NO",
+	   sb->buf.len);
     }
 
-  if (!sock->stream_buf.residual_fully_formed)
-    stream_buf_set_next (&sock->stream_buf);
-  return !sock->stream_buf.residual_fully_formed;
+#ifdef WIN32
+  /* the overlapped recv() is queued right away */
+  if (!sb->residual_fully_formed)
+    stream_buf_set_next (sb);
+#endif
+  return !sb->residual_fully_formed;
 }
 
 bool
@@ -1903,19 +2012,14 @@ stream_buf_added (struct stream_buf *sb,
   /* is our incoming packet fully read? */
   if (sb->len > 0 && sb->buf.len >= sb->len)
     {
-      /* save any residual data that's part of the next packet */
-      ASSERT (buf_init (&sb->residual, 0));
-      if (sb->buf.len > sb->len)
-	  ASSERT (buf_copy_excess (&sb->residual, &sb->buf, sb->len));
-      dmsg (D_STREAM_DEBUG, "STREAM: ADD returned TRUE, buf_len=%d, residual_len=%d",
+      dmsg (D_STREAM_DEBUG, "STREAM: ADD returned TRUE, buf_len=%d, packet_len=%d",
 	   BLEN (&sb->buf),
-	   BLEN (&sb->residual));
+	   sb->len);
       return true;
     }
   else
     {
       dmsg (D_STREAM_DEBUG, "STREAM: ADD returned FALSE (have=%d need=%d)", sb->buf.len, sb->len);
-      stream_buf_set_next (sb);
       return false;
     }
 }
@@ -1924,6 +2028,14 @@ void
 stream_buf_close (struct stream_buf* sb)
 {
   free_buf (&sb->residual);
+  if (sb->shared)
+    {
+      if (stream_buf_shared_owner == sb)
+	stream_buf_shared_owner = NULL;
+      if (!--stream_buf_shared_refcount)
+	free_buf (&stream_buf_shared);
+      sb->shared = false;
+    }
 }
 
 /*
@@ -2179,6 +2291,13 @@ link_socket_read_tcp (struct link_socket *sock,
       len = socket_finalize (sock->sd, &sock->reads, buf, NULL);
 #else
       struct buffer frag;
+
+      /*
+       * Only move unread data around now.  Until the next read,
+       * the last packet handed out may still be waiting in
+       * to_tun, in place.
+       */
+      stream_buf_set_next (&sock->stream_buf);
       stream_buf_get_next (&sock->stream_buf, &frag);
       len = recv (sock->sd, BPTR (&frag), BLEN (&frag), MSG_NOSIGNAL);
 #endif
@@ -2193,7 +2312,6 @@ link_socket_read_tcp (struct link_socket *sock,
       || stream_buf_added (&sock->stream_buf, len)) /* packet complete? */
     {
       stream_buf_get_final (&sock->stream_buf, buf);
-      stream_buf_reset (&sock->stream_buf);
       return buf->len;
     }
   else
@@ -2296,6 +2414,54 @@ link_socket_write_tcp (struct link_socket *sock,
 #endif
 }
 
+#if TCP_WRITEV_CAPABILITY
+
+/*
+ * Write n packets to a TCP socket with a single sendmsg(),
+ * each preceded by its packet_size_type length.  The first
+ * skip bytes of this framed data were already sent by an
+ * earlier short write and are left out.  Returns the number
+ * of bytes written, or -1.
+ */
+int
+link_socket_write_tcp_batch (struct link_socket *sock,
+			     struct buffer *const *bufs,
+			     const int n,
+			     int skip)
+{
+  struct iovec iov[2 * TCP_WRITEV_MAX];
+  packet_size_type net_len[TCP_WRITEV_MAX];
+  struct msghdr mesg;
+  int i;
+
+  ASSERT (n > 0 && n <= TCP_WRITEV_MAX);
+  for (i = 0; i < n; ++i)
+    {
+      ASSERT (BLEN (bufs[i]) <= sock->stream_buf.maxlen);
+      net_len[i] = htonps ((packet_size_type) BLEN (bufs[i]));
+      iov[2*i].iov_base = &net_len[i];
+      iov[2*i].iov_len = sizeof (packet_size_type);
+      iov[2*i+1].iov_base = BPTR (bufs[i]);
+      iov[2*i+1].iov_len = BLEN (bufs[i]);
+    }
+
+  for (i = 0; skip > 0; ++i)
+    {
+      const int k = min_int (skip, (int) iov[i].iov_len);
+      iov[i].iov_base = (uint8_t *) iov[i].iov_base + k;
+      iov[i].iov_len -= k;
+      skip -= k;
+    }
+
+  CLEAR (mesg);
+  mesg.msg_iov = iov;
+  mesg.msg_iovlen = 2 * n;
+  dmsg (D_STREAM_DEBUG, "STREAM: WRITE BATCH %d packets", n);
+  return sendmsg (sock->sd, &mesg, MSG_NOSIGNAL);
+}
+
+#endif
+
 #if ENABLE_IP_PKTINFO
 
 int
@@ -105,17 +105,33 @@ struct link_socket_info
 /*
  * Used to extract packets encapsulated in streams into a buffer,
  * in this case IP packets embedded in a TCP stream.
+ *
+ * Each recv() reads as much of the stream as fits in buf_init,
+ * and packets are handed out in place, one per read call, until
+ * only a partial packet is left.
+ *
+ * TCP server instances only have room for one packet of their
+ * own.  They recv() into a read area shared by the process, and
+ * whatever is still unread there moves back into the instance's
+ * own buffer when another instance needs the read area.
+ */
+
+/*
+ * Extra space beyond one packet in the stream read buffer.
  */
+#define STREAM_BUF_READ_SIZE 65536
+
 struct stream_buf
 {
   struct buffer buf_init;
-  struct buffer residual;
+  struct buffer residual;  /* stream bytes read by someone else, e.g. an HTTP proxy */
   int maxlen;
-  bool residual_fully_formed;
+  bool residual_fully_formed; /* buf holds a complete packet, no recv() needed */
+  bool shared; /* recv() into the process-wide read area */
 
-  struct buffer buf;
+  struct buffer buf;       /* unparsed stream data */
   struct buffer next;
-  int len;     /* -1 if not yet known */
+  int len;     /* length of packet at head of buf, -1 if not yet known */
 
   bool error;  /* if true, fatal TCP error has occurred,
 		  requiring that connection be restarted */
@@ -694,6 +710,7 @@ void stream_buf_init (struct stream_buf *sb,
 		      const unsigned int sockflags,
 		      const int proto);
 
+void stream_buf_share (struct stream_buf *sb, const int size);
 void stream_buf_close (struct stream_buf* sb);
 bool stream_buf_added (struct stream_buf *sb, int length_added);
 
@@ -772,6 +789,18 @@ int link_socket_write_tcp (struct link_socket *sock,
 			   struct buffer *buf,
 			   struct link_socket_actual *to);
 
+#if TCP_WRITEV_CAPABILITY
+
+/* max number of packets coalesced into one TCP write */
+#define TCP_WRITEV_MAX 32
+
+int link_socket_write_tcp_batch (struct link_socket *sock,
+				 struct buffer *const *bufs,
+				 const int n,
+				 int skip);
+
+#endif
+
 #ifdef WIN32
 
 static inline int
@@ -51,6 +51,7 @@
 #include "gremlin.h"
 #include "pkcs11.h"
 #include "list.h"
+#include "metrics.h"
 
 #ifdef WIN32
 #include "cryptoapi.h"
@@ -388,6 +389,242 @@ cert_hash_remember (struct tls_session *session, const int error_depth, const un
     }
 }
 
+/*
+ * Verified certificate chain cache functions
+ */
+struct verify_cache *
+verify_cache_new (int size, interval_t ttl)
+{
+  struct verify_cache *vc;
+
+  ASSERT (size > 0);
+  ALLOC_OBJ_CLEAR (vc, struct verify_cache);
+  vc->size = size;
+  vc->ttl = ttl;
+  ALLOC_ARRAY_CLEAR (vc->entries, struct verify_cache_entry, size);
+  return vc;
+}
+
+void
+verify_cache_free (struct verify_cache *vc)
+{
+  if (vc)
+    {
+      free (vc->entries);
+      free (vc);
+    }
+}
+
+static void
+verify_cache_flush (struct verify_cache *vc)
+{
+  int i;
+  for (i = 0; i < vc->size; ++i)
+    CLEAR (vc->entries[i]);
+}
+
+/* chain hashes are already uniformly distributed */
+static inline struct verify_cache_entry *
+verify_cache_slot (struct verify_cache *vc, const unsigned char *chain_hash)
+{
+  uint32_t h;
+  memcpy (&h, chain_hash, sizeof (h));
+  return &vc->entries[h % vc->size];
+}
+
+/*
+ * Entries are only valid against the CRL they were verified with,
+ * so flush the cache whenever the CRL has been reloaded.
+ */
+static bool
+verify_cache_lookup (struct verify_cache *vc, const unsigned char *chain_hash,
+		     const struct crl_index *ci)
+{
+  const struct verify_cache_entry *e;
+
+  if (ci && ci->generation != vc->crl_generation)
+    {
+      dmsg (D_HANDSHAKE, "VERIFY CACHE: %s reloaded, flushing", ci->filename);
+      verify_cache_flush (vc);
+      vc->crl_generation = ci->generation;
+    }
+  e = verify_cache_slot (vc, chain_hash);
+  return e->expire > now && !memcmp (e->chain_hash, chain_hash, SHA_DIGEST_LENGTH);
+}
+
+static void
+verify_cache_add (struct verify_cache *vc, const unsigned char *chain_hash)
+{
+  struct verify_cache_entry *e = verify_cache_slot (vc, chain_hash);
+  memcpy (e->chain_hash, chain_hash, SHA_DIGEST_LENGTH);
+  e->expire = now + vc->ttl;
+}
+
+/*
+ * CRL index functions
+ */
+struct crl_index *
+crl_index_new (const char *filename)
+{
+  struct crl_index *ci;
+  ALLOC_OBJ_CLEAR (ci, struct crl_index);
+  ci->filename = filename;
+  crl_index_update (ci);
+  return ci;
+}
+
+void
+crl_index_free (struct crl_index *ci)
+{
+  if (ci)
+    {
+      free (ci->serials);
+      if (ci->crl)
+	X509_CRL_free (ci->crl);
+      free (ci);
+    }
+}
+
+static int
+crl_serial_cmp (const void *a, const void *b)
+{
+  return ASN1_INTEGER_cmp (*(ASN1_INTEGER * const *) a, *(ASN1_INTEGER * const *) b);
+}
+
+/*
+ * Read the CRL file and build a new sorted serial number array,
+ * replacing the current one only once the new one is complete.
+ * The first load is fatal on error, like the per-handshake read
+ * it replaces; a failed reload keeps the previous CRL in effect.
+ * Returns true if the CRL was (re)loaded.
+ */
+static bool
+crl_index_load (struct crl_index *ci)
+{
+  const int msglevel = ci->crl ? M_WARN : M_ERR;
+  X509_CRL *crl = NULL;
+  ASN1_INTEGER **serials = NULL;
+  BIO *in;
+  int i, n;
+  bool ret = false;
+
+  in = BIO_new (BIO_s_file ());
+  if (in == NULL)
+    {
+      msg (msglevel, "CRL: BIO err");
+      return false;
+    }
+  if (BIO_read_filename (in, ci->filename) <= 0)
+    {
+      msg (msglevel, "CRL: cannot read: %s", ci->filename);
+      goto done;
+    }
+  crl = PEM_read_bio_X509_CRL (in, NULL, NULL, NULL);
+  if (crl == NULL)
+    {
+      msg (msglevel, "CRL: cannot read CRL from file %s", ci->filename);
+      goto done;
+    }
+
+  /* a CRL without revoked entries has no stack at all, and num () returns -1 */
+  n = max_int (sk_X509_REVOKED_num (X509_CRL_get_REVOKED (crl)), 0);
+  if (n > 0)
+    {
+      ALLOC_ARRAY (serials, ASN1_INTEGER *, n);
+      for (i = 0; i < n; ++i)
+	{
+	  X509_REVOKED *revoked = (X509_REVOKED *)sk_X509_REVOKED_value (X509_CRL_get_REVOKED (crl), i);
+	  serials[i] = revoked->serialNumber;
+	}
+      qsort (serials, n, sizeof (ASN1_INTEGER *), crl_serial_cmp);
+    }
+
+  free (ci->serials);
+  if (ci->crl)
+    X509_CRL_free (ci->crl);
+  ci->crl = crl;
+  ci->serials = serials;
+  ci->n_serials = n;
+  ++ci->generation;
+  crl = NULL;
+  ret = true;
+  msg (D_HANDSHAKE, "CRL: loaded %d revoked serial numbers from %s", n, ci->filename);
+
+ done:
+  BIO_free (in);
+  if (crl)
+    X509_CRL_free (crl);
+  return ret;
+}
+
+/*
+ * Reload the CRL if the file has changed, looking at the file
+ * at most every CRL_CHECK_INTERVAL seconds.  The mtime and size
+ * are only remembered once the file parsed, so that a file
+ * caught half-written is read again on the next check.
+ */
+void
+crl_index_update (struct crl_index *ci)
+{
+  if (ci->crl && now < ci->last_check + CRL_CHECK_INTERVAL)
+    return;
+  ci->last_check = now;
+  {
+#ifdef HAVE_STAT
+    struct stat st;
+
+    if (stat (ci->filename, &st))
+      {
+	if (!ci->crl)
+	  crl_index_load (ci);  /* report the error */
+	return;
+      }
+    if (ci->crl && st.st_mtime == ci->mtime && st.st_size == ci->size)
+      return;
+    if (crl_index_load (ci))
+      {
+	ci->mtime = st.st_mtime;
+	ci->size = st.st_size;
+      }
+#else
+    crl_index_load (ci);
+#endif
+  }
+}
+
+/* true if cert's serial number is listed in the CRL */
+static bool
+crl_index_revoked (const struct crl_index *ci, X509 *cert)
+{
+  ASN1_INTEGER *serial = X509_get_serialNumber (cert);
+  if (!ci->n_serials)
+    return false;
+  return bsearch (&serial, ci->serials, ci->n_serials,
+		  sizeof (ASN1_INTEGER *), crl_serial_cmp) != NULL;
+}
+
+/*
+ * Hash the certificate chain being verified into chain_hash.
+ */
+static bool
+verify_chain_hash (X509_STORE_CTX *ctx, unsigned char *chain_hash)
+{
+  STACK_OF(X509) *chain = X509_STORE_CTX_get_chain (ctx);
+  SHA_CTX sha;
+  int i;
+
+  if (!chain)
+    return false;
+  SHA1_Init (&sha);
+  for (i = 0; i < sk_X509_num (chain); ++i)
+    {
+      X509 *cert = sk_X509_value (chain, i);
+      SHA1_Update (&sha, cert->sha1_hash, SHA_DIGEST_LENGTH);
+    }
+  SHA1_Final (chain_hash, &sha);
+  return true;
+}
+
 #if 0
 static void
 cert_hash_print (const struct cert_hash_set *chs, int msglevel)
@@ -778,6 +1015,8 @@ verify_callback (int preverify_ok, X509_STORE_CTX * ctx)
   const struct tls_options *opt;
   const int max_depth = MAX_CERT_DEPTH;
   struct argv argv = argv_new ();
+  unsigned char chain_hash[SHA_DIGEST_LENGTH];
+  bool cache_chain = false;
 
   /* get the tls_session pointer */
   ssl = X509_STORE_CTX_get_ex_data (ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
@@ -904,6 +1143,17 @@ verify_callback (int preverify_ok, X509_STORE_CTX * ctx)
   /* export current untrusted IP */
   setenv_untrusted (session);
 
+  /* skip the checks below if this chain passed them recently */
+  if (opt->verify_cache && verify_chain_hash (ctx, chain_hash))
+    {
+      if (verify_cache_lookup (opt->verify_cache, chain_hash, opt->crl_index))
+	{
+	  msg (D_HANDSHAKE, "VERIFY OK (cached): depth=%d, %s", ctx->error_depth, subject);
+	  goto ok;
+	}
+      cache_chain = true;
+    }
+
   /* verify certificate nsCertType */
   if (opt->ns_cert_type && ctx->error_depth == 0)
     {
@@ -1038,57 +1288,31 @@ verify_callback (int preverify_ok, X509_STORE_CTX * ctx)
   /* check peer cert against CRL */
   if (opt->crl_file)
     {
-      X509_CRL *crl=NULL;
-      X509_REVOKED *revoked;
-      BIO *in=NULL;
-      int n,i,retval = 0;
-
-      in=BIO_new(BIO_s_file());
+      const struct crl_index *ci = opt->crl_index;
 
-      if (in == NULL) {
-	msg (M_ERR, "CRL: BIO err");
-	goto end;
-      }
-      if (BIO_read_filename(in, opt->crl_file) <= 0) {
-	msg (M_ERR, "CRL: cannot read: %s", opt->crl_file);
-	goto end;
-      }
-      crl=PEM_read_bio_X509_CRL(in,NULL,NULL,NULL);
-      if (crl == NULL) {
-	msg (M_ERR, "CRL: cannot read CRL from file %s", opt->crl_file);
-	goto end;
-      }
-
-      if (X509_NAME_cmp(X509_CRL_get_issuer(crl), X509_get_issuer_name(ctx->current_cert)) != 0) {
-	msg (M_WARN, "CRL: CRL %s is from a different issuer than the issuer of certificate %s", opt->crl_file, subject);
-	retval = 1;
-	goto end;
-      }
-
-      n = sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl));
-
-      for (i = 0; i < n; i++) {
-	revoked = (X509_REVOKED *)sk_X509_REVOKED_value(X509_CRL_get_REVOKED(crl), i);
-	if (ASN1_INTEGER_cmp(revoked->serialNumber, X509_get_serialNumber(ctx->current_cert)) == 0) {
-	  msg (D_HANDSHAKE, "CRL CHECK FAILED: %s is REVOKED",subject);
-	  goto end;
+      ASSERT (ci && ci->crl);
+      if (X509_NAME_cmp (X509_CRL_get_issuer (ci->crl), X509_get_issuer_name (ctx->current_cert)) != 0)
+	{
+	  msg (M_WARN, "CRL: CRL %s is from a different issuer than the issuer of certificate %s", opt->crl_file, subject);
+	}
+      else if (crl_index_revoked (ci, ctx->current_cert))
+	{
+	  msg (D_HANDSHAKE, "CRL CHECK FAILED: %s is REVOKED", subject);
+	  goto err;
+	}
+      else
+	{
+	  msg (D_HANDSHAKE, "CRL CHECK OK: %s", subject);
 	}
-      }
-
-      retval = 1;
-      msg (D_HANDSHAKE, "CRL CHECK OK: %s",subject);
-
-    end:
-
-      BIO_free(in);
-      if (crl)
-	X509_CRL_free (crl);
-      if (!retval)
-	goto err;
     }
 
   msg (D_HANDSHAKE, "VERIFY OK: depth=%d, %s", ctx->error_depth, subject);
 
+  /* depth 0 is verified last, so the whole chain has passed */
+  if (cache_chain && ctx->error_depth == 0)
+    verify_cache_add (opt->verify_cache, chain_hash);
+
+ ok:
   session->verified = true;
   OPENSSL_free (subject);
   argv_reset (&argv);
@@ -2384,10 +2608,11 @@ key_state_init (struct tls_session *session, struct key_state *ks)
   ks->plaintext_write_buf = alloc_buf (TLS_CHANNEL_BUF_SIZE);
   ks->ack_write_buf = alloc_buf (BUF_SIZE (&session->opt->frame));
   reliable_init (ks->send_reliable, BUF_SIZE (&session->opt->frame),
-		 FRAME_HEADROOM (&session->opt->frame), TLS_RELIABLE_N_SEND_BUFFERS,
+		 FRAME_HEADROOM (&session->opt->frame), session->opt->reliable_window,
 		 ks->key_id ? false : session->opt->xmit_hold);
   reliable_init (ks->rec_reliable, BUF_SIZE (&session->opt->frame),
-		 FRAME_HEADROOM (&session->opt->frame), TLS_RELIABLE_N_REC_BUFFERS,
+		 FRAME_HEADROOM (&session->opt->frame),
+		 max_int (session->opt->reliable_window, TLS_RELIABLE_N_REC_BUFFERS),
 		 false);
   reliable_set_timeout (ks->send_reliable, session->opt->packet_timeout);
 
@@ -2401,11 +2626,92 @@ key_state_init (struct tls_session *session, struct key_state *ks)
 #endif
 }
 
+/*
+ * Server-side renegotiation scheduling.  All key_state objects
+ * share one --reneg-max-rate budget per second of wall clock.
+ */
+static time_t reneg_rate_second;   /* GLOBAL */
+static int reneg_rate_started;     /* GLOBAL */
+static int reneg_pending;          /* GLOBAL */
+static int reneg_in_progress;      /* GLOBAL */
+
+void
+tls_reneg_status (int *pending, int *in_progress)
+{
+  *pending = reneg_pending;
+  *in_progress = reneg_in_progress;
+}
+
+/*
+ * Remove a key_state from the renegotiation counters.
+ */
+static void
+key_state_reneg_done (struct key_state *ks)
+{
+  if (ks->reneg_deferred)
+    {
+      ks->reneg_deferred = false;
+      --reneg_pending;
+    }
+  if (ks->reneg_in_progress)
+    {
+      ks->reneg_in_progress = false;
+      --reneg_in_progress;
+    }
+}
+
+/*
+ * Return true if a --reneg-max-rate slot is available
+ * for a soft reset in the current second.
+ */
+static bool
+reneg_rate_admit (const struct tls_options *o)
+{
+  if (!o->server || !o->renegotiate_max_rate)
+    return true;
+  if (reneg_rate_second != now)
+    {
+      reneg_rate_second = now;
+      reneg_rate_started = 0;
+    }
+  if (reneg_rate_started < o->renegotiate_max_rate)
+    {
+      ++reneg_rate_started;
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Time at which a key that just went active should be
+ * renegotiated.  A server advances the deadline by a random
+ * amount of up to --reneg-jitter seconds (capped at half of
+ * --reneg-sec), so that clients which connected together
+ * don't all renegotiate together.
+ */
+static time_t
+key_state_reneg_deadline (const struct tls_options *o)
+{
+  interval_t jitter = 0;
+
+  if (!o->renegotiate_seconds)
+    return 0;
+  if (o->server && o->renegotiate_jitter > 0)
+    {
+      const interval_t max = min_int (o->renegotiate_jitter, o->renegotiate_seconds / 2);
+      if (max > 0)
+	jitter = get_random () % (max + 1);
+    }
+  return now + o->renegotiate_seconds - jitter;
+}
+
 static void
 key_state_free (struct key_state *ks, bool clear)
 {
   ks->state = S_UNDEF;
 
+  key_state_reneg_done (ks);
+
   if (ks->ssl) {
 #ifdef BIO_DEBUG
     bio_debug_oc ("close ssl_bio", ks->ssl_bio);
@@ -2734,6 +3040,35 @@ tls_multi_free (struct tls_multi *multi, bool clear)
   free(multi);
 }
 
+size_t
+tls_multi_memory (const struct tls_multi *multi)
+{
+  size_t ret = 0;
+  int i, j;
+
+  if (multi)
+    {
+      ret += sizeof (*multi);
+      for (i = 0; i < TM_SIZE; ++i)
+	for (j = 0; j < KS_SIZE; ++j)
+	  {
+	    const struct key_state *ks = &multi->session[i].key[j];
+	    if (ks->key_src)
+	      ret += sizeof (*ks->key_src);
+	    if (ks->send_reliable)
+	      ret += reliable_memory (ks->send_reliable);
+	    if (ks->rec_reliable)
+	      ret += reliable_memory (ks->rec_reliable);
+	    if (ks->rec_ack)
+	      ret += sizeof (*ks->rec_ack);
+	    ret += ks->plaintext_read_buf.capacity
+	      + ks->plaintext_write_buf.capacity
+	      + ks->ack_write_buf.capacity;
+	  }
+    }
+  return ret;
+}
+
 /*
  * Move a packet authentication HMAC + related fields to or from the front
  * of the buffer so it can be processed by encrypt/decrypt.
@@ -3248,12 +3583,48 @@ static void
 key_state_soft_reset (struct tls_session *session)
 {
   ks->must_die = now + session->opt->transition_window; /* remaining lifetime of old key */
+  key_state_reneg_done (ks);
   key_state_free (ks_lame, false);
   *ks_lame = *ks;
 
   key_state_init (session, ks);
   ks->session_id_remote = ks_lame->session_id_remote;
   ks->remote_addr = ks_lame->remote_addr;
+
+  ks->reneg_in_progress = true;
+  ++reneg_in_progress;
+}
+
+/*
+ * Return true if the primary key is due for a soft reset.  Time and
+ * traffic based renegotiations on a server are subject to
+ * --reneg-max-rate; a refused key is counted as pending and retried
+ * a second later.  Imminent packet-id wrap is never deferred.
+ */
+static bool
+key_state_reneg_due (struct tls_session *session)
+{
+  const struct tls_options *o = session->opt;
+
+  if (ks->state < S_ACTIVE)
+    return false;
+  if (packet_id_close_to_wrapping (&ks->packet_id.send))
+    return true;
+  if (!((ks->renegotiate_at && now >= ks->renegotiate_at)
+	|| (o->renegotiate_bytes && ks->n_bytes >= o->renegotiate_bytes)
+	|| (o->renegotiate_packets && ks->n_packets >= o->renegotiate_packets)))
+    return false;
+  if (reneg_rate_admit (o))
+    return true;
+
+  if (!ks->reneg_deferred)
+    {
+      ks->reneg_deferred = true;
+      ++reneg_pending;
+      dmsg (D_TLS_DEBUG, "TLS: soft reset deferred by --reneg-max-rate");
+    }
+  ks->renegotiate_at = now + 1;
+  return false;
 }
 
 /*
@@ -4023,18 +4394,11 @@ tls_process (struct tls_multi *multi,
   ASSERT (session_id_defined (&session->session_id));
 
   /* Should we trigger a soft reset? -- new key, keeps old key for a while */
-  if (ks->state >= S_ACTIVE &&
-      ((session->opt->renegotiate_seconds
-	&& now >= ks->established + session->opt->renegotiate_seconds)
-       || (session->opt->renegotiate_bytes
-	   && ks->n_bytes >= session->opt->renegotiate_bytes)
-       || (session->opt->renegotiate_packets
-	   && ks->n_packets >= session->opt->renegotiate_packets)
-       || (packet_id_close_to_wrapping (&ks->packet_id.send))))
+  if (key_state_reneg_due (session))
     {
       msg (D_TLS_DEBUG_LOW,
            "TLS: soft reset sec=%d bytes=" counter_format "/%d pkts=" counter_format "/%d",
-	   (int)(ks->established + session->opt->renegotiate_seconds - now),
+	   ks->renegotiate_at ? (int)(ks->renegotiate_at - now) : 0,
 	   ks->n_bytes, session->opt->renegotiate_bytes,
 	   ks->n_packets, session->opt->renegotiate_packets);
       key_state_soft_reset (session);
@@ -4075,6 +4439,7 @@ tls_process (struct tls_multi *multi,
 	      if (buf)
 		{
 		  ks->must_negotiate = now + session->opt->handshake_window;
+		  openvpn_now_tv (&ks->handshake_start);
 		  ks->auth_deferred_expire = now + auth_deferred_expire_window (session->opt);
 
 		  /* null buffer */
@@ -4132,6 +4497,8 @@ tls_process (struct tls_multi *multi,
 	      if (FULL_SYNC)
 		{
 		  ks->established = now;
+		  ks->renegotiate_at = key_state_reneg_deadline (session->opt);
+		  key_state_reneg_done (ks);
 		  dmsg (D_TLS_DEBUG_MED, "STATE S_ACTIVE");
 		  if (check_debug_level (D_HANDSHAKE))
 		    print_details (ks->ssl, "Control Channel:");
@@ -4139,39 +4506,28 @@ tls_process (struct tls_multi *multi,
 		  ks->state = S_ACTIVE;
 		  INCR_SUCCESS;
 
+		  {
+		    struct timeval tv;
+		    openvpn_now_tv (&tv);
+		    metric_tls_handshake (tv_subtract (&tv, &ks->handshake_start, 600) / 1000);
+		  }
+
 		  /* Set outgoing address for data channel packets */
 		  link_socket_set_outgoing_addr (NULL, to_link_socket_info, &ks->remote_addr, session->common_name, session->opt->es);
 
 		  /* Flush any payload packets that were buffered before our state transitioned to S_ACTIVE */
 		  flush_payload_buffer (multi, ks);
 
+		  /* Handshake is done, release the idle control channel windows */
+		  reliable_trim (ks->send_reliable);
+		  reliable_trim (ks->rec_reliable);
+
 #ifdef MEASURE_TLS_HANDSHAKE_STATS
 		  show_tls_performance_stats();
 #endif
 		}
 	    }
 
-	  /* Reliable buffer to outgoing TCP/UDP (send up to CONTROL_SEND_ACK_MAX ACKs
-	     for previously received packets) */
-	  if (!to_link->len && reliable_can_send (ks->send_reliable))
-	    {
-	      int opcode;
-	      struct buffer b;
-
-	      buf = reliable_send (ks->send_reliable, &opcode);
-	      ASSERT (buf);
-	      b = *buf;
-	      INCR_SENT;
-
-	      write_control_auth (session, ks, &b, to_link_addr, opcode,
-				  CONTROL_SEND_ACK_MAX, true);
-	      *to_link = b;
-	      active = true;
-	      state_change = true;
-	      dmsg (D_TLS_DEBUG, "Reliable -> TCP/UDP");
-	      break;
-	    }
-
 #ifndef TLS_AGGREGATE_ACK
 	  /* Send 1 or more ACKs (each received control packet gets one ACK) */
 	  if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
@@ -4312,10 +4668,22 @@ tls_process (struct tls_multi *multi,
 	  /* Outgoing Ciphertext to reliable buffer */
 	  if (ks->state >= S_START)
 	    {
-	      buf = reliable_get_buf_output_sequenced (ks->send_reliable);
+	      const int maxlen = PAYLOAD_SIZE_DYNAMIC (&multi->opt.frame);
+	      int room = 0;
+
+	      /* Top up a control packet which hasn't gone out yet, so that
+		 TLS records produced in one pass share a datagram */
+	      buf = reliable_get_buf_output_unsent (ks->send_reliable, P_CONTROL_V1);
 	      if (buf)
+		room = maxlen - (BLEN (buf) - (int) sizeof (packet_id_type));
+	      if (room > 0)
 		{
-		  int status = key_state_read_ciphertext (multi, ks, buf, PAYLOAD_SIZE_DYNAMIC (&multi->opt.frame));
+		  struct buffer tail = *buf;
+		  int status;
+
+		  tail.offset += tail.len;
+		  tail.len = 0;
+		  status = key_state_read_ciphertext (multi, ks, &tail, room);
 		  if (status == -1)
 		    {
 		      msg (D_TLS_ERRORS,
@@ -4324,10 +4692,30 @@ tls_process (struct tls_multi *multi,
 		    }
 		  if (status == 1)
 		    {
-		      reliable_mark_active_outgoing (ks->send_reliable, buf, P_CONTROL_V1);
-		      INCR_GENERATED;
+		      buf->len += tail.len;
 		      state_change = true;
-		      dmsg (D_TLS_DEBUG, "Outgoing Ciphertext -> Reliable");
+		      dmsg (D_TLS_DEBUG, "Outgoing Ciphertext -> Reliable (appended)");
+		    }
+		}
+	      else
+		{
+		  buf = reliable_get_buf_output_sequenced (ks->send_reliable);
+		  if (buf)
+		    {
+		      int status = key_state_read_ciphertext (multi, ks, buf, maxlen);
+		      if (status == -1)
+			{
+			  msg (D_TLS_ERRORS,
+			       "TLS Error: Ciphertext -> reliable TCP/UDP transport read error");
+			  goto error;
+			}
+		      if (status == 1)
+			{
+			  reliable_mark_active_outgoing (ks->send_reliable, buf, P_CONTROL_V1);
+			  INCR_GENERATED;
+			  state_change = true;
+			  dmsg (D_TLS_DEBUG, "Outgoing Ciphertext -> Reliable");
+			}
 		    }
 		}
 	    }
@@ -4337,6 +4725,30 @@ tls_process (struct tls_multi *multi,
 
   update_time ();
 
+  /*
+   * Reliable buffer to outgoing TCP/UDP (send up to CONTROL_SEND_ACK_MAX ACKs
+   * for previously received packets).  This is deferred until the state
+   * machine has settled, so that everything TLS produced in this pass
+   * is packed into as few datagrams as possible, and pending ACKs ride
+   * along instead of going out as dedicated P_ACK_V1 packets.
+   */
+  if (!to_link->len && reliable_can_send (ks->send_reliable))
+    {
+      int opcode;
+      struct buffer b;
+
+      buf = reliable_send (ks->send_reliable, &opcode);
+      ASSERT (buf);
+      b = *buf;
+      INCR_SENT;
+
+      write_control_auth (session, ks, &b, to_link_addr, opcode,
+			  CONTROL_SEND_ACK_MAX, true);
+      *to_link = b;
+      active = true;
+      dmsg (D_TLS_DEBUG, "Reliable -> TCP/UDP");
+    }
+
 #ifdef TLS_AGGREGATE_ACK
   /* Send 1 or more ACKs (each received control packet gets one ACK) */
   if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
@@ -4363,9 +4775,8 @@ tls_process (struct tls_multi *multi,
 	  compute_earliest_wakeup (wakeup, ks->must_negotiate - now);
       }
 
-    if (ks->established && session->opt->renegotiate_seconds)
-      compute_earliest_wakeup (wakeup,
-        ks->established + session->opt->renegotiate_seconds - now);
+    if (ks->renegotiate_at)
+      compute_earliest_wakeup (wakeup, ks->renegotiate_at - now);
 
     /* prevent event-loop spinning by setting minimum wakeup of 1 second */
     if (*wakeup <= 0)
@@ -4388,6 +4799,7 @@ error:
   ks->state = S_ERROR;
   msg (D_TLS_ERRORS, "TLS Error: TLS handshake failed");
   INCR_ERROR;
+  ++metrics.tls_errors;
   gc_free (&gc);
   return false;
 }
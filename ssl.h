@@ -250,13 +250,13 @@
  * can "hitch a ride" on an outgoing
  * non-P_ACK_V1 control packet.
  */
-#define CONTROL_SEND_ACK_MAX 4
+#define CONTROL_SEND_ACK_MAX RELIABLE_ACK_SIZE
 
 /*
  * Define number of buffers for send and receive in the reliability layer.
  */
-#define TLS_RELIABLE_N_SEND_BUFFERS  4 /* also window size for reliablity layer */
-#define TLS_RELIABLE_N_REC_BUFFERS   8
+#define TLS_RELIABLE_N_SEND_BUFFERS  4 /* default window size for reliablity layer (--tls-window) */
+#define TLS_RELIABLE_N_REC_BUFFERS   8 /* minimum receive window */
 
 /*
  * Various timeouts
@@ -319,6 +319,53 @@ struct cert_hash_set {
   struct cert_hash *ch[MAX_CERT_DEPTH];
 };
 
+/*
+ * In-memory index of the --crl-verify file: the revoked serial
+ * numbers, sorted for binary search.  The file is loaded when the
+ * index is created, and crl_index_update, called from the coarse
+ * timers, re-reads it when its modification time or size changes,
+ * which is checked at most once every CRL_CHECK_INTERVAL seconds.
+ * Certificate verification only ever looks at the loaded index.
+ */
+#define CRL_CHECK_INTERVAL 5
+
+struct crl_index {
+  const char *filename;
+  X509_CRL *crl;
+  ASN1_INTEGER **serials;	/* point into crl, sorted */
+  int n_serials;
+  time_t mtime;
+  off_t size;
+  time_t last_check;
+  unsigned int generation;	/* incremented on every (re)load */
+};
+
+struct crl_index *crl_index_new (const char *filename);
+void crl_index_free (struct crl_index *ci);
+void crl_index_update (struct crl_index *ci);
+
+/*
+ * Cache of peer certificate chains which passed all
+ * verify_callback checks (--verify-cache), keyed by a SHA1
+ * over the hashes of the certificates in the chain.  Entries
+ * expire after ttl seconds, and the whole cache is flushed
+ * when the --crl-verify file is reloaded.
+ */
+struct verify_cache_entry {
+  unsigned char chain_hash[SHA_DIGEST_LENGTH];
+  time_t expire;		/* 0 if slot unused */
+};
+
+struct verify_cache {
+  int size;
+  interval_t ttl;
+  unsigned int crl_generation;	/* crl_index generation the entries were verified against */
+  struct verify_cache_entry *entries;
+};
+
+struct verify_cache *verify_cache_new (int size, interval_t ttl);
+void verify_cache_free (struct verify_cache *vc);
+
 /*
  * Key material, used as source for PRF-based
  * key expansion.
@@ -359,7 +406,12 @@ struct key_state
 
   time_t established;		/* when our state went S_ACTIVE */
   time_t must_negotiate;	/* key negotiation times out if not finished before this time */
+  struct timeval handshake_start; /* when our initial handshake packet went out */
   time_t must_die;		/* this object is destroyed at this time */
+  time_t renegotiate_at;	/* --reneg-sec soft reset is due at this time, 0 if never */
+
+  bool reneg_deferred;		/* soft reset is due but was refused a --reneg-max-rate slot */
+  bool reneg_in_progress;	/* soft reset started, not yet S_ACTIVE */
 
   int initial_opcode;		/* our initial P_ opcode */
   struct session_id session_id_remote;   /* peer's random session ID */
@@ -442,15 +494,20 @@ struct tls_options
   int transition_window;
   int handshake_window;
   interval_t packet_timeout;
+  int reliable_window;
   int renegotiate_bytes;
   int renegotiate_packets;
   interval_t renegotiate_seconds;
+  interval_t renegotiate_jitter;
+  int renegotiate_max_rate;
 
   /* cert verification parms */
   const char *verify_command;
   const char *verify_export_cert;
   const char *verify_x509name;
   const char *crl_file;
+  struct crl_index *crl_index;
+  struct verify_cache *verify_cache;
   int ns_cert_type;
   unsigned remote_cert_ku[MAX_PARMS];
   const char *remote_cert_eku;
@@ -682,6 +739,12 @@ int tls_multi_process (struct tls_multi *multi,
 
 void tls_multi_free (struct tls_multi *multi, bool clear);
 
+/* approximate heap bytes held by multi, excluding SSL library state */
+size_t tls_multi_memory (const struct tls_multi *multi);
+
+/* Global counts of deferred and in-progress key renegotiations */
+void tls_reneg_status (int *pending, int *in_progress);
+
 bool tls_pre_decrypt (struct tls_multi *multi,
 		      const struct link_socket_actual *from,
 		      struct buffer *buf,
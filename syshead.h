@@ -89,6 +89,10 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
@@ -531,11 +535,29 @@ socket_defined (const socket_descriptor_t sd)
 #define UNIX_SOCK_SUPPORT 0
 #endif
 
+/*
+ * Can we coalesce queued TCP output into one
+ * gather write (sendmsg with an iovec array)?
+ */
+#if defined(HAVE_SENDMSG) && defined(HAVE_SYS_UIO_H) && !defined(WIN32)
+#define TCP_WRITEV_CAPABILITY 1
+#else
+#define TCP_WRITEV_CAPABILITY 0
+#endif
+
 /*
  * Compile the struct buffer_list code
  */
 #define ENABLE_BUFFER_LIST
 
+/*
+ * Compile the lock-free struct buffer_ring code
+ * (needs the GCC __sync atomic builtins)
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define ENABLE_BUFFER_RING
+#endif
+
 /*
  * Should we include OCC (options consistency check) code?
  */
@@ -627,6 +649,31 @@ socket_defined (const socket_descriptor_t sd)
  */
 #define TIME_BACKTRACK_PROTECTION 1
 
+/*
+ * Drive now from a monotonic clock where one is available,
+ * so that timeouts are immune to system clock steps.
+ *
+ * Prefer CLOCK_BOOTTIME, which keeps counting while the
+ * device is suspended, so that keepalive and renegotiation
+ * deadlines expire on resume like they did with time(NULL).
+ * It has no coarse variant.  Otherwise the once-per-loop
+ * refresh uses the coarse monotonic clock, which is good
+ * enough for our timers and much cheaper to read.
+ */
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC) && !defined(WIN32)
+#define TIME_MONOTONIC 1
+#if defined(CLOCK_BOOTTIME)
+#define OPENVPN_CLOCK        CLOCK_BOOTTIME
+#define OPENVPN_CLOCK_COARSE CLOCK_BOOTTIME
+#elif defined(CLOCK_MONOTONIC_COARSE)
+#define OPENVPN_CLOCK        CLOCK_MONOTONIC
+#define OPENVPN_CLOCK_COARSE CLOCK_MONOTONIC_COARSE
+#else
+#define OPENVPN_CLOCK        CLOCK_MONOTONIC
+#define OPENVPN_CLOCK_COARSE CLOCK_MONOTONIC
+#endif
+#endif
+
 /*
  * Is non-blocking connect() supported?
  */
@@ -25,6 +25,10 @@ trap "rm -f key.$$ log.$$ ; exit 1" 0 3
 set +e
 ( ./openvpn --test-crypto --secret key.$$ ) >log.$$ 2>&1
 e=$?
+if [ $e = 0 ] ; then
+  ( ./openvpn --benchmark 1000 --secret key.$$ ) >>log.$$ 2>&1
+  e=$?
+fi
 if [ $e != 0 ] ; then cat log.$$ ; fi
 rm key.$$ log.$$
 trap 0
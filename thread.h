@@ -45,12 +45,12 @@
 #define L_PLUGIN       11
 #define N_MUTEXES      12
 
+#define CACHE_LINE_SIZE 128
+
 #ifdef USE_PTHREAD
 
 #define MAX_THREADS     50
 
-#define CACHE_LINE_SIZE 128
-
 /*
  * Improve SMP performance by making sure that each
  * mutex resides in its own cache line.